@@ -17,6 +17,17 @@ elseif(CMAKE_CXX_COMPILER_FRONTEND_VARIANT STREQUAL "GNU") # gcc and clang
   add_compile_options(-Wall -Wextra -Werror -pedantic)
 endif()
 
+# NOTE: SSE2 is always available on x86-64, but AVX2 has to be requested explicitly,
+# as binaries compiled with it won't start on older CPUs.
+option(GRAPHICS_COURSE_ENABLE_AVX2 "Allow the compiler to use AVX2 instructions" OFF)
+if(GRAPHICS_COURSE_ENABLE_AVX2)
+  if(CMAKE_CXX_COMPILER_FRONTEND_VARIANT STREQUAL "MSVC")
+    add_compile_options(/arch:AVX2)
+  else()
+    add_compile_options(-mavx2)
+  endif()
+endif()
+
 add_compile_definitions(
   GRAPHICS_COURSE_RESOURCES_ROOT="${PROJECT_SOURCE_DIR}/resources"
   GRAPHICS_COURSE_ROOT="${PROJECT_SOURCE_DIR}"
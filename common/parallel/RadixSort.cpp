@@ -0,0 +1,94 @@
+#include "RadixSort.hpp"
+
+#include <algorithm>
+
+
+namespace
+{
+
+constexpr std::size_t RADIX_BITS = 8;
+constexpr std::size_t PASS_COUNT = 64 / RADIX_BITS;
+
+// Smaller parts are not worth waking up the worker threads for
+constexpr std::size_t MIN_PART_SIZE = 8192;
+
+} // namespace
+
+void RadixSorter::sort(
+  std::span<std::uint64_t> keys, std::span<std::uint32_t> values, ThreadPool* pool)
+{
+  const std::size_t count = keys.size();
+  if (count < 2)
+    return;
+
+  tempKeys.resize(count);
+  tempValues.resize(count);
+
+  // Passes over bits that are the same in all of the keys wouldn't move anything
+  std::uint64_t differingBits = 0;
+  for (auto key : keys)
+    differingBits |= key ^ keys[0];
+
+  const std::size_t threadCount = pool != nullptr ? pool->getThreadCount() : 1;
+  const std::size_t partCount = std::clamp<std::size_t>(count / MIN_PART_SIZE, 1, threadCount);
+  const std::size_t partSize = (count + partCount - 1) / partCount;
+  partOffsets.resize(partCount);
+
+  auto forEachPart = [&](auto&& func) {
+    auto run = [&](std::size_t part) {
+      func(part, part * partSize, std::min(count, (part + 1) * partSize));
+    };
+    if (partCount == 1)
+      run(0);
+    else
+      pool->parallelFor(partCount, run);
+  };
+
+  std::span<std::uint64_t> srcKeys = keys;
+  std::span<std::uint32_t> srcValues = values;
+  std::span<std::uint64_t> dstKeys = tempKeys;
+  std::span<std::uint32_t> dstValues = tempValues;
+
+  for (std::size_t pass = 0; pass < PASS_COUNT; ++pass)
+  {
+    const std::size_t shift = pass * RADIX_BITS;
+    if (((differingBits >> shift) & (RADIX - 1)) == 0)
+      continue;
+
+    forEachPart([&](std::size_t part, std::size_t begin, std::size_t end) {
+      auto& counts = partOffsets[part];
+      counts.fill(0);
+      for (std::size_t i = begin; i < end; ++i)
+        ++counts[(srcKeys[i] >> shift) & (RADIX - 1)];
+    });
+
+    // NOTE: going over parts within every digit keeps equal keys in their original order
+    std::uint32_t offset = 0;
+    for (std::size_t digit = 0; digit < RADIX; ++digit)
+      for (auto& offsets : partOffsets)
+      {
+        const std::uint32_t digitCount = offsets[digit];
+        offsets[digit] = offset;
+        offset += digitCount;
+      }
+
+    forEachPart([&](std::size_t part, std::size_t begin, std::size_t end) {
+      auto& offsets = partOffsets[part];
+      for (std::size_t i = begin; i < end; ++i)
+      {
+        const std::uint32_t position = offsets[(srcKeys[i] >> shift) & (RADIX - 1)]++;
+        dstKeys[position] = srcKeys[i];
+        dstValues[position] = srcValues[i];
+      }
+    });
+
+    std::swap(srcKeys, dstKeys);
+    std::swap(srcValues, dstValues);
+  }
+
+  if (srcKeys.data() != keys.data())
+  {
+    std::copy(srcKeys.begin(), srcKeys.end(), keys.begin());
+    std::copy(srcValues.begin(), srcValues.end(), values.begin());
+  }
+}
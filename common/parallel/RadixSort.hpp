@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "parallel/ThreadPool.hpp"
+
+
+/**
+ * Stable LSD radix sort of 64-bit keys carrying 32-bit values, one byte per pass.
+ * Bytes that are the same in all of the keys are skipped, so keys that only use a part
+ * of their bits need only as many passes as there are bytes in use. Large arrays are split
+ * between threads of the pool, every thread counting and then scattering its own part.
+ * Temporary buffers are kept between calls, so sorting every frame doesn't allocate.
+ */
+class RadixSorter
+{
+public:
+  // Both spans must be of the same size, values are moved along with their keys
+  void sort(
+    std::span<std::uint64_t> keys, std::span<std::uint32_t> values, ThreadPool* pool = nullptr);
+
+private:
+  static constexpr std::size_t RADIX = 256;
+
+  std::vector<std::uint64_t> tempKeys;
+  std::vector<std::uint32_t> tempValues;
+  // Digit counts of every part of the array, turned into offsets before scattering
+  std::vector<std::array<std::uint32_t, RADIX>> partOffsets;
+};
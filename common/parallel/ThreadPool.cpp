@@ -0,0 +1,113 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+
+struct ThreadPool::Job
+{
+  fu2::function_view<void(std::size_t)> func;
+  std::size_t count;
+  std::atomic<std::size_t> next{0};
+  // Guarded by the pool mutex. The job lives on the submitter's stack,
+  // so it must not return while some worker still holds a pointer to it.
+  std::size_t activeWorkers = 0;
+};
+
+ThreadPool::ThreadPool(std::size_t thread_count)
+{
+  if (thread_count == 0)
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+  workers.reserve(thread_count - 1);
+  for (std::size_t i = 1; i < thread_count; ++i)
+    workers.emplace_back([this]() { workerLoop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard lock{mutex};
+    stopping = true;
+  }
+  jobAvailable.notify_all();
+
+  for (auto& worker : workers)
+    worker.join();
+}
+
+void ThreadPool::runJob(Job& job)
+{
+  for (std::size_t i = job.next.fetch_add(1, std::memory_order_relaxed); i < job.count;
+       i = job.next.fetch_add(1, std::memory_order_relaxed))
+    job.func(i);
+}
+
+void ThreadPool::workerLoop()
+{
+  std::unique_lock lock{mutex};
+  while (true)
+  {
+    jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+    if (stopping)
+      return;
+
+    Job* job = jobs.front();
+    ++job->activeWorkers;
+
+    lock.unlock();
+    runJob(*job);
+    lock.lock();
+
+    // All indices of the job are handed out by now, nobody else should pick it up
+    if (auto it = std::find(jobs.begin(), jobs.end(), job); it != jobs.end())
+      jobs.erase(it);
+
+    if (--job->activeWorkers == 0)
+      jobReleased.notify_all();
+  }
+}
+
+void ThreadPool::parallelFor(std::size_t count, fu2::function_view<void(std::size_t)> func)
+{
+  if (count == 0)
+    return;
+
+  if (workers.empty() || count == 1)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+      func(i);
+    return;
+  }
+
+  Job job{.func = func, .count = count};
+
+  {
+    std::lock_guard lock{mutex};
+    jobs.push_back(&job);
+  }
+  jobAvailable.notify_all();
+
+  runJob(job);
+
+  std::unique_lock lock{mutex};
+  if (auto it = std::find(jobs.begin(), jobs.end(), &job); it != jobs.end())
+    jobs.erase(it);
+
+  // Workers release the job only after finishing their last index, and the
+  // mutex makes all of their writes visible to us.
+  jobReleased.wait(lock, [&job]() { return job.activeWorkers == 0; });
+}
+
+void ThreadPool::parallelForChunks(
+  std::size_t count,
+  std::size_t chunk_size,
+  fu2::function_view<void(std::size_t, std::size_t)> func)
+{
+  chunk_size = std::max<std::size_t>(chunk_size, 1);
+  const std::size_t chunkCount = (count + chunk_size - 1) / chunk_size;
+  parallelFor(chunkCount, [&](std::size_t chunk) {
+    const std::size_t begin = chunk * chunk_size;
+    func(begin, std::min(count, begin + chunk_size));
+  });
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <function2/function2.hpp>
+
+
+/**
+ * Minimal pool of worker threads for data-parallel loops.
+ * The calling thread always participates in the work it submits, so it is fine
+ * to call parallelFor from several threads at once or even from inside a job.
+ */
+class ThreadPool
+{
+public:
+  // 0 means "as many threads as the hardware supports"
+  explicit ThreadPool(std::size_t thread_count = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Amount of threads that execute a job, including the calling one
+  std::size_t getThreadCount() const { return workers.size() + 1; }
+
+  // Calls func(i) for every i in [0, count) and waits for all calls to finish
+  void parallelFor(std::size_t count, fu2::function_view<void(std::size_t)> func);
+
+  // Same as above, but hands out contiguous [begin, end) ranges of at most chunk_size elements
+  void parallelForChunks(
+    std::size_t count,
+    std::size_t chunk_size,
+    fu2::function_view<void(std::size_t, std::size_t)> func);
+
+private:
+  struct Job;
+
+  void workerLoop();
+  static void runJob(Job& job);
+
+private:
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable jobAvailable;
+  std::condition_variable jobReleased;
+  std::deque<Job*> jobs;
+  bool stopping = false;
+};
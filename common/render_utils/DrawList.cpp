@@ -0,0 +1,86 @@
+#include "DrawList.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <etna/Assert.hpp>
+
+
+namespace
+{
+
+constexpr std::uint32_t RELEM_SHIFT = 0;
+constexpr std::uint32_t INDEX_FORMAT_SHIFT = RELEM_SHIFT + DrawList::RELEM_BITS;
+constexpr std::uint32_t DEPTH_BUCKET_SHIFT = INDEX_FORMAT_SHIFT + DrawList::INDEX_FORMAT_BITS;
+constexpr std::uint32_t MATERIAL_SHIFT = DEPTH_BUCKET_SHIFT + DrawList::DEPTH_BUCKET_BITS;
+constexpr std::uint32_t PIPELINE_SHIFT = MATERIAL_SHIFT + DrawList::MATERIAL_BITS;
+constexpr std::uint32_t LAYER_SHIFT = PIPELINE_SHIFT + DrawList::PIPELINE_BITS;
+
+static_assert(LAYER_SHIFT + DrawList::LAYER_BITS <= 64);
+
+// Depth buckets per doubling of the distance, starting from the smallest distance below
+constexpr float DEPTH_BUCKETS_PER_OCTAVE = 64.0f;
+constexpr float MIN_DEPTH_LOG2 = -4.0f;
+
+std::uint64_t pack_field(std::uint32_t value, std::uint32_t bits, std::uint32_t shift)
+{
+  return (static_cast<std::uint64_t>(value) & ((1ull << bits) - 1)) << shift;
+}
+
+std::uint32_t unpack_field(std::uint64_t key, std::uint32_t bits, std::uint32_t shift)
+{
+  return static_cast<std::uint32_t>((key >> shift) & ((1ull << bits) - 1));
+}
+
+} // namespace
+
+std::uint64_t DrawList::packKey(const DrawKey& key)
+{
+  // NOTE: a field that doesn't fit would be masked and silently merge draws that differ
+  ETNA_VERIFY(key.layer < (1u << LAYER_BITS));
+  ETNA_VERIFY(key.pipeline < (1u << PIPELINE_BITS));
+  ETNA_VERIFY(key.material < (1u << MATERIAL_BITS));
+  ETNA_VERIFY(key.depthBucket < (1u << DEPTH_BUCKET_BITS));
+  ETNA_VERIFY(key.indexFormat < (1u << INDEX_FORMAT_BITS));
+  ETNA_VERIFY(key.relem < (1u << RELEM_BITS));
+
+  return pack_field(key.layer, LAYER_BITS, LAYER_SHIFT) |
+    pack_field(key.pipeline, PIPELINE_BITS, PIPELINE_SHIFT) |
+    pack_field(key.material, MATERIAL_BITS, MATERIAL_SHIFT) |
+    pack_field(key.depthBucket, DEPTH_BUCKET_BITS, DEPTH_BUCKET_SHIFT) |
+    pack_field(key.indexFormat, INDEX_FORMAT_BITS, INDEX_FORMAT_SHIFT) |
+    pack_field(key.relem, RELEM_BITS, RELEM_SHIFT);
+}
+
+DrawKey DrawList::unpackKey(std::uint64_t key)
+{
+  return DrawKey{
+    .layer = unpack_field(key, LAYER_BITS, LAYER_SHIFT),
+    .pipeline = unpack_field(key, PIPELINE_BITS, PIPELINE_SHIFT),
+    .material = unpack_field(key, MATERIAL_BITS, MATERIAL_SHIFT),
+    .depthBucket = unpack_field(key, DEPTH_BUCKET_BITS, DEPTH_BUCKET_SHIFT),
+    .indexFormat = unpack_field(key, INDEX_FORMAT_BITS, INDEX_FORMAT_SHIFT),
+    .relem = unpack_field(key, RELEM_BITS, RELEM_SHIFT),
+  };
+}
+
+std::uint32_t DrawList::getDepthBucket(float view_depth)
+{
+  constexpr float LAST_BUCKET = static_cast<float>((1u << DEPTH_BUCKET_BITS) - 1);
+
+  // NOTE: also takes care of negative depths and NaNs, which end up in the first bucket
+  const float bucket =
+    (std::log2(std::max(1e-6f, view_depth)) - MIN_DEPTH_LOG2) * DEPTH_BUCKETS_PER_OCTAVE;
+  return static_cast<std::uint32_t>(std::clamp(bucket, 0.0f, LAST_BUCKET));
+}
+
+void DrawList::clear()
+{
+  keys.clear();
+  instances.clear();
+}
+
+void DrawList::sort(ThreadPool* pool)
+{
+  sorter.sort(keys, instances, pool);
+}
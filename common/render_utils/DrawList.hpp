@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "parallel/RadixSort.hpp"
+
+
+// Everything that decides where a draw goes in a sorted draw list
+struct DrawKey
+{
+  // Layer of a layered target, draws of a layer are recorded together
+  std::uint32_t layer;
+  std::uint32_t pipeline;
+  std::uint32_t material;
+  // 0 for all draws when they are not ordered by depth, see DrawList::getDepthBucket
+  std::uint32_t depthBucket;
+  // Draws of a relem only differ in instances, so they can be merged into instanced calls
+  std::uint32_t indexFormat;
+  std::uint32_t relem;
+};
+
+/**
+ * Draws of a frame with 64-bit sort keys. Fields of the key go from the most expensive state
+ * to change to the least, so that after sorting draws sharing a pipeline, a material and
+ * an index buffer follow each other. Depth buckets go right below materials: when they are
+ * used, draws of a material come front to back, otherwise draws of a relem are all together.
+ * The sort is stable, so adding draws of a relem in order of instances keeps them in that order.
+ */
+class DrawList
+{
+public:
+  static constexpr std::uint32_t RELEM_BITS = 24;
+  static constexpr std::uint32_t INDEX_FORMAT_BITS = 1;
+  static constexpr std::uint32_t DEPTH_BUCKET_BITS = 10;
+  static constexpr std::uint32_t MATERIAL_BITS = 12;
+  static constexpr std::uint32_t PIPELINE_BITS = 4;
+  static constexpr std::uint32_t LAYER_BITS = 2;
+
+  static std::uint64_t packKey(const DrawKey& key);
+  static DrawKey unpackKey(std::uint64_t key);
+
+  // Buckets are spaced logarithmically, so close objects get finer ones
+  static std::uint32_t getDepthBucket(float view_depth);
+
+  void clear();
+  void add(const DrawKey& key, std::uint32_t instance)
+  {
+    keys.push_back(packKey(key));
+    instances.push_back(instance);
+  }
+  void sort(ThreadPool* pool = nullptr);
+
+  std::size_t size() const { return keys.size(); }
+  std::span<const std::uint64_t> getKeys() const { return keys; }
+  std::span<const std::uint32_t> getInstances() const { return instances; }
+
+private:
+  std::vector<std::uint64_t> keys;
+  std::vector<std::uint32_t> instances;
+  RadixSorter sorter;
+};
@@ -0,0 +1,190 @@
+#include "ParallelRecorder.hpp"
+
+#include <algorithm>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+
+
+namespace
+{
+
+// Fewer draws than this per buffer are recorded faster than a thread is woken up
+constexpr std::size_t MIN_RANGE_SIZE = 256;
+
+vk::Viewport full_viewport(const vk::Rect2D& rect)
+{
+  return vk::Viewport{
+    .x = static_cast<float>(rect.offset.x),
+    .y = static_cast<float>(rect.offset.y),
+    .width = static_cast<float>(rect.extent.width),
+    .height = static_cast<float>(rect.extent.height),
+    .minDepth = 0.0f,
+    .maxDepth = 1.0f,
+  };
+}
+
+} // namespace
+
+ParallelRecorder::ParallelRecorder(ThreadPool& thread_pool)
+  : threadPool{thread_pool}
+  , device{etna::get_context().getDevice()}
+  , slotPools{etna::get_context().getMainWorkCount(), [this](std::size_t) {
+                std::vector<SlotPool> slots(threadPool.getThreadCount());
+                for (auto& slot : slots)
+                  slot.pool = etna::unwrap_vk_result(
+                    device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+                      .flags = vk::CommandPoolCreateFlagBits::eTransient,
+                      .queueFamilyIndex = etna::get_context().getQueueFamilyIdx(),
+                    }));
+                return slots;
+              }}
+{
+}
+
+void ParallelRecorder::beginFrame()
+{
+  // NOTE: resetting a pool resets all of its buffers at once, which is cheaper than one by one
+  for (auto& slot : slotPools.get())
+  {
+    ETNA_CHECK_VK_RESULT(device.resetCommandPool(slot.pool.get()));
+    slot.usedBuffers = 0;
+  }
+}
+
+vk::CommandBuffer ParallelRecorder::acquireBuffer(SlotPool& slot)
+{
+  if (slot.usedBuffers == slot.buffers.size())
+  {
+    auto buffers =
+      etna::unwrap_vk_result(device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{
+        .commandPool = slot.pool.get(),
+        .level = vk::CommandBufferLevel::eSecondary,
+        .commandBufferCount = 1,
+      }));
+    slot.buffers.push_back(buffers.front());
+  }
+  return slot.buffers[slot.usedBuffers++];
+}
+
+void ParallelRecorder::beginRendering(
+  vk::CommandBuffer cmd_buf, const RenderingInfo& info, vk::RenderingFlags flags)
+{
+  std::vector<vk::RenderingAttachmentInfo> colorAttachments;
+  for (const auto& attachment : info.colorAttachments)
+  {
+    etna::set_state(
+      cmd_buf,
+      attachment.image,
+      vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+      vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite,
+      vk::ImageLayout::eColorAttachmentOptimal,
+      vk::ImageAspectFlagBits::eColor);
+    colorAttachments.push_back(vk::RenderingAttachmentInfo{
+      .imageView = attachment.view,
+      .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+      .loadOp = attachment.loadOp,
+      .storeOp = vk::AttachmentStoreOp::eStore,
+      .clearValue = attachment.clearValue,
+    });
+  }
+
+  std::optional<vk::RenderingAttachmentInfo> depthAttachment;
+  if (info.depthAttachment.has_value())
+  {
+    const auto& attachment = *info.depthAttachment;
+    etna::set_state(
+      cmd_buf,
+      attachment.image,
+      vk::PipelineStageFlagBits2::eEarlyFragmentTests |
+        vk::PipelineStageFlagBits2::eLateFragmentTests,
+      vk::AccessFlagBits2::eDepthStencilAttachmentRead |
+        vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+      vk::ImageLayout::eDepthStencilAttachmentOptimal,
+      vk::ImageAspectFlagBits::eDepth);
+    depthAttachment = vk::RenderingAttachmentInfo{
+      .imageView = attachment.view,
+      .imageLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal,
+      .loadOp = attachment.loadOp,
+      .storeOp = vk::AttachmentStoreOp::eStore,
+      .clearValue = attachment.clearValue,
+    };
+  }
+
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.beginRendering(vk::RenderingInfo{
+    .flags = flags,
+    .renderArea = info.rect,
+    .layerCount = info.layerCount,
+    .colorAttachmentCount = static_cast<std::uint32_t>(colorAttachments.size()),
+    .pColorAttachments = colorAttachments.data(),
+    .pDepthAttachment = depthAttachment.has_value() ? &*depthAttachment : nullptr,
+  });
+}
+
+void ParallelRecorder::render(
+  vk::CommandBuffer cmd_buf,
+  const RenderingInfo& info,
+  std::size_t count,
+  fu2::function_view<void(vk::CommandBuffer, std::size_t, std::size_t)> record)
+{
+  // NOTE: secondary buffers may be recorded at any point before they are executed,
+  // the primary one is not touched by the workers in the meantime
+  beginRendering(cmd_buf, info, vk::RenderingFlagBits::eContentsSecondaryCommandBuffers);
+
+  std::vector<vk::Format> colorFormats;
+  for (const auto& attachment : info.colorAttachments)
+    colorFormats.push_back(attachment.format);
+
+  // Secondary buffers only inherit formats of the attachments, everything else is set anew
+  const vk::CommandBufferInheritanceRenderingInfo inheritanceRendering{
+    .colorAttachmentCount = static_cast<std::uint32_t>(colorFormats.size()),
+    .pColorAttachmentFormats = colorFormats.data(),
+    .depthAttachmentFormat =
+      info.depthAttachment.has_value() ? info.depthAttachment->format : vk::Format::eUndefined,
+    .rasterizationSamples = vk::SampleCountFlagBits::e1,
+  };
+  const vk::CommandBufferInheritanceInfo inheritance{.pNext = &inheritanceRendering};
+
+  const vk::Viewport viewport = full_viewport(info.rect);
+
+  // One range per slot at most, so that a slot is only ever used by a single thread
+  auto& slots = slotPools.get();
+  const std::size_t rangeCount = std::clamp<std::size_t>(count / MIN_RANGE_SIZE, 1, slots.size());
+  const std::size_t rangeSize = (count + rangeCount - 1) / rangeCount;
+
+  std::vector<vk::CommandBuffer> secondaries(rangeCount);
+  threadPool.parallelFor(rangeCount, [&](std::size_t range) {
+    auto secondary = acquireBuffer(slots[range]);
+    ETNA_CHECK_VK_RESULT(secondary.begin(vk::CommandBufferBeginInfo{
+      .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+        vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+      .pInheritanceInfo = &inheritance,
+    }));
+
+    secondary.setViewport(0, {viewport});
+    secondary.setScissor(0, {info.rect});
+    record(secondary, range * rangeSize, std::min(count, (range + 1) * rangeSize));
+
+    ETNA_CHECK_VK_RESULT(secondary.end());
+    secondaries[range] = secondary;
+  });
+
+  cmd_buf.executeCommands(secondaries);
+  cmd_buf.endRendering();
+}
+
+void ParallelRecorder::renderInline(
+  vk::CommandBuffer cmd_buf,
+  const RenderingInfo& info,
+  fu2::function_view<void(vk::CommandBuffer)> record)
+{
+  beginRendering(cmd_buf, info, {});
+
+  cmd_buf.setViewport(0, {full_viewport(info.rect)});
+  cmd_buf.setScissor(0, {info.rect});
+  record(cmd_buf);
+
+  cmd_buf.endRendering();
+}
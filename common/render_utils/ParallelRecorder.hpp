@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/GpuSharedResource.hpp>
+#include <function2/function2.hpp>
+
+#include "parallel/ThreadPool.hpp"
+
+
+/**
+ * Records draws of a pass into secondary command buffers on threads of a pool and
+ * executes them from the primary one. Every thread slot of every frame in flight has its
+ * own command pool, as a pool can't be used by two threads at once, and its buffers can
+ * only be reset once the GPU is done with the frame they were recorded for.
+ */
+class ParallelRecorder
+{
+public:
+  struct Attachment
+  {
+    vk::Image image;
+    vk::ImageView view;
+    vk::Format format;
+    vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eClear;
+    vk::ClearValue clearValue = {};
+  };
+
+  struct RenderingInfo
+  {
+    vk::Rect2D rect;
+    std::vector<Attachment> colorAttachments;
+    std::optional<Attachment> depthAttachment;
+    // Attachments of layered passes are views of several layers, see gl_Layer
+    std::uint32_t layerCount = 1;
+  };
+
+  explicit ParallelRecorder(ThreadPool& thread_pool);
+
+  // Makes buffers recorded for the previous use of the current frame in flight available again,
+  // must be called once per frame after the GPU is done with it and before any render()
+  void beginFrame();
+
+  // Splits [0, count) into ranges, each recorded by record(cmd_buf, begin, end) into its own
+  // secondary command buffer, and executes them within a rendering scope over the attachments.
+  // Secondary buffers start with the viewport and scissor covering the rect and nothing bound.
+  // NOTE: RenderTargetState can't begin a scope for secondary buffers, so this does it
+  // by hand, including layout transitions of the attachments.
+  void render(
+    vk::CommandBuffer cmd_buf,
+    const RenderingInfo& info,
+    std::size_t count,
+    fu2::function_view<void(vk::CommandBuffer, std::size_t, std::size_t)> record);
+
+  // The same scope recorded straight into cmd_buf, for passes that RenderTargetState
+  // can't begin either and that are not worth splitting, e.g. small layered ones
+  void renderInline(
+    vk::CommandBuffer cmd_buf,
+    const RenderingInfo& info,
+    fu2::function_view<void(vk::CommandBuffer)> record);
+
+private:
+  struct SlotPool
+  {
+    vk::UniqueCommandPool pool;
+    std::vector<vk::CommandBuffer> buffers;
+    std::size_t usedBuffers = 0;
+  };
+
+  vk::CommandBuffer acquireBuffer(SlotPool& slot);
+  // Transitions the attachments and begins rendering to them
+  static void beginRendering(
+    vk::CommandBuffer cmd_buf, const RenderingInfo& info, vk::RenderingFlags flags);
+
+private:
+  ThreadPool& threadPool;
+  vk::Device device;
+  etna::GpuSharedResource<std::vector<SlotPool>> slotPools;
+};
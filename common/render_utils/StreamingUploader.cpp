@@ -0,0 +1,192 @@
+#include "StreamingUploader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <etna/GlobalContext.hpp>
+
+
+StreamingUploader::StreamingUploader(CreateInfo info)
+  : chunkSize{info.chunkSize}
+  , device{etna::get_context().getDevice()}
+  , queue{etna::get_context().getQueue()}
+{
+  auto& ctx = etna::get_context();
+
+  commandPool = etna::unwrap_vk_result(device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+    .flags = vk::CommandPoolCreateFlagBits::eTransient |
+      vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    .queueFamilyIndex = ctx.getQueueFamilyIdx(),
+  }));
+
+  staging = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = chunkSize * info.chunkCount,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "streaming_uploader_staging",
+  });
+  stagingData = staging.map();
+
+  auto commandBuffers =
+    etna::unwrap_vk_result(device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{
+      .commandPool = commandPool.get(),
+      .level = vk::CommandBufferLevel::ePrimary,
+      .commandBufferCount = static_cast<std::uint32_t>(info.chunkCount),
+    }));
+
+  chunks.resize(info.chunkCount);
+  for (std::size_t i = 0; i < info.chunkCount; ++i)
+  {
+    chunks[i].commandBuffer = commandBuffers[i];
+    chunks[i].fence = etna::unwrap_vk_result(device.createFenceUnique(vk::FenceCreateInfo{}));
+  }
+}
+
+StreamingUploader::~StreamingUploader()
+{
+  wait();
+  staging.unmap();
+}
+
+void StreamingUploader::uploadBuffer(
+  etna::Buffer& dst, vk::DeviceSize offset, std::span<const std::byte> data)
+{
+  while (!data.empty())
+  {
+    auto& chunk = acquireChunk();
+    const std::size_t chunkIdx = currentChunk;
+
+    if (chunk.used == 0)
+      begin(chunk);
+
+    const auto size = std::min<vk::DeviceSize>(data.size(), chunkSize - chunk.used);
+    const vk::DeviceSize stagingOffset = chunkIdx * chunkSize + chunk.used;
+
+    std::memcpy(stagingData + stagingOffset, data.data(), size);
+
+    const vk::BufferCopy region{
+      .srcOffset = stagingOffset,
+      .dstOffset = offset,
+      .size = size,
+    };
+    chunk.commandBuffer.copyBuffer(staging.get(), dst.get(), 1, &region);
+
+    chunk.used += size;
+    offset += size;
+    data = data.subspan(size);
+
+    if (chunk.used == chunkSize)
+      submit(chunk);
+  }
+}
+
+void StreamingUploader::flush()
+{
+  auto& chunk = chunks[currentChunk];
+  if (!chunk.inFlight && chunk.used > 0)
+    submit(chunk);
+}
+
+bool StreamingUploader::poll()
+{
+  bool idle = true;
+  for (auto& chunk : chunks)
+  {
+    if (chunk.inFlight && device.getFenceStatus(chunk.fence.get()) == vk::Result::eSuccess)
+      chunk.inFlight = false;
+    idle = idle && !chunk.inFlight;
+  }
+  return idle;
+}
+
+vk::DeviceSize StreamingUploader::freeSpace()
+{
+  poll();
+
+  // NOTE: chunks are used in order, so only the ones following the current chunk count
+  vk::DeviceSize result = 0;
+  for (std::size_t i = 0; i < chunks.size(); ++i)
+  {
+    const auto& chunk = chunks[(currentChunk + i) % chunks.size()];
+    if (chunk.inFlight)
+      break;
+    result += chunkSize - chunk.used;
+  }
+  return result;
+}
+
+void StreamingUploader::wait()
+{
+  flush();
+
+  for (auto& chunk : chunks)
+    if (chunk.inFlight)
+    {
+      ETNA_CHECK_VK_RESULT(device.waitForFences(
+        {chunk.fence.get()}, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+      chunk.inFlight = false;
+    }
+}
+
+StreamingUploader::Chunk& StreamingUploader::acquireChunk()
+{
+  auto& chunk = chunks[currentChunk];
+  if (!chunk.inFlight)
+    return chunk;
+
+  // NOTE: chunks are submitted in order, so this one is the oldest in flight
+  ETNA_CHECK_VK_RESULT(device.waitForFences(
+    {chunk.fence.get()}, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+  chunk.inFlight = false;
+  return chunk;
+}
+
+void StreamingUploader::begin(Chunk& chunk)
+{
+  ETNA_CHECK_VK_RESULT(chunk.commandBuffer.begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  }));
+
+  // Destinations may still be read by frames in flight, e.g. when data of the current scene
+  // changes, so the copies wait for everything submitted to the queue before them.
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .srcAccessMask = {},
+    .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .dstAccessMask = {},
+  };
+  chunk.commandBuffer.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
+
+void StreamingUploader::submit(Chunk& chunk)
+{
+  // Make the copies visible to everything that is submitted to the queue later on
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite,
+  };
+  chunk.commandBuffer.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+
+  ETNA_CHECK_VK_RESULT(chunk.commandBuffer.end());
+
+  ETNA_CHECK_VK_RESULT(device.resetFences({chunk.fence.get()}));
+
+  const vk::SubmitInfo submitInfo{
+    .commandBufferCount = 1,
+    .pCommandBuffers = &chunk.commandBuffer,
+  };
+  ETNA_CHECK_VK_RESULT(queue.submit(1, &submitInfo, chunk.fence.get()));
+
+  chunk.used = 0;
+  chunk.inFlight = true;
+  currentChunk = (currentChunk + 1) % chunks.size();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+
+
+/**
+ * Uploads data to GPU-only buffers through a persistently mapped staging ring.
+ * The ring is split into chunks, each recorded into its own command buffer and
+ * guarded by its own fence, so many uploads can be in flight at once and the CPU
+ * only waits when it runs out of chunks that the GPU has finished copying.
+ *
+ * Copies are submitted to the main queue between barriers, so they never overwrite data
+ * that earlier submissions still read, and anything submitted afterwards sees the results.
+ * etna only creates a universal queue, so there is no dedicated transfer queue to offload
+ * the copies to.
+ */
+class StreamingUploader
+{
+public:
+  struct CreateInfo
+  {
+    vk::DeviceSize chunkSize = 4 << 20;
+    std::size_t chunkCount = 16;
+  };
+
+  explicit StreamingUploader(CreateInfo info);
+  ~StreamingUploader();
+
+  StreamingUploader(const StreamingUploader&) = delete;
+  StreamingUploader& operator=(const StreamingUploader&) = delete;
+
+  // Copies the data into the ring right away, the destination buffer is written later on
+  // by the GPU. Blocks only while all of the chunks are still being processed by the GPU.
+  void uploadBuffer(etna::Buffer& dst, vk::DeviceSize offset, std::span<const std::byte> data);
+
+  template <class T>
+  void uploadBuffer(etna::Buffer& dst, vk::DeviceSize offset, std::span<const T> data)
+  {
+    uploadBuffer(dst, offset, std::as_bytes(data));
+  }
+
+  // Submits the partially filled chunk, if there is one
+  void flush();
+
+  // Retires chunks that the GPU has finished with, never blocks. Returns true when there
+  // is nothing left in flight, i.e. all of the flushed uploads are complete.
+  bool poll();
+
+  // Amount of data that can be uploaded right now without waiting for the GPU
+  vk::DeviceSize freeSpace();
+
+  // Flushes and blocks until all of the uploads are complete
+  void wait();
+
+private:
+  struct Chunk
+  {
+    vk::CommandBuffer commandBuffer;
+    vk::UniqueFence fence;
+    vk::DeviceSize used = 0;
+    bool inFlight = false;
+  };
+
+  Chunk& acquireChunk();
+  void begin(Chunk& chunk);
+  void submit(Chunk& chunk);
+
+private:
+  vk::DeviceSize chunkSize;
+
+  vk::Device device;
+  vk::Queue queue;
+  vk::UniqueCommandPool commandPool;
+
+  etna::Buffer staging;
+  std::byte* stagingData;
+
+  std::vector<Chunk> chunks;
+  std::size_t currentChunk = 0;
+};
@@ -0,0 +1,159 @@
+#include "BakedScene.hpp"
+
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+
+namespace baked
+{
+
+namespace
+{
+
+template <class T>
+std::optional<std::span<const T>> get_section(
+  std::span<const std::byte> data, const Header& header, Section section)
+{
+  const auto& range = header.sections[static_cast<std::size_t>(section)];
+  if (
+    range.offset % SECTION_ALIGNMENT != 0 || range.size % sizeof(T) != 0 ||
+    range.offset > data.size() || range.size > data.size() - range.offset)
+  {
+    spdlog::error(
+      "Baked scene: section {} is misaligned or out of bounds",
+      static_cast<std::uint32_t>(section));
+    return std::nullopt;
+  }
+
+  // NOTE: the data itself is checked to be aligned, so aligned offsets give aligned pointers
+  return std::span<const T>{
+    reinterpret_cast<const T*>(data.data() + range.offset),
+    static_cast<std::size_t>(range.size / sizeof(T))};
+}
+
+} // namespace
+
+std::optional<SceneView> parse(std::span<const std::byte> data)
+{
+  if (data.size() < sizeof(Header))
+  {
+    spdlog::error("Baked scene: file is too small to contain a header");
+    return std::nullopt;
+  }
+
+  if (reinterpret_cast<std::uintptr_t>(data.data()) % SECTION_ALIGNMENT != 0)
+  {
+    spdlog::error("Baked scene: data is not aligned properly");
+    return std::nullopt;
+  }
+
+  Header header;
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  if (header.magic != MAGIC)
+  {
+    spdlog::error("Baked scene: bad magic, this is not a baked scene");
+    return std::nullopt;
+  }
+
+  if (header.version != VERSION || header.sectionCount != SECTION_COUNT)
+  {
+    spdlog::error(
+      "Baked scene: version {} is not supported, expected {}. Please re-bake the scene.",
+      header.version,
+      VERSION);
+    return std::nullopt;
+  }
+
+  if (header.vertexStride != sizeof(Vertex))
+  {
+    spdlog::error(
+      "Baked scene: vertex stride is {}, expected {}", header.vertexStride, sizeof(Vertex));
+    return std::nullopt;
+  }
+
+  auto vertices = get_section<Vertex>(data, header, Section::Vertices);
+  auto indices = get_section<std::uint32_t>(data, header, Section::Indices);
+  auto relems = get_section<RenderElement>(data, header, Section::RenderElements);
+  auto meshes = get_section<Mesh>(data, header, Section::Meshes);
+  auto instanceMatrices = get_section<glm::mat4x4>(data, header, Section::InstanceMatrices);
+  auto instanceMeshes = get_section<std::uint32_t>(data, header, Section::InstanceMeshes);
+  auto meshlets = get_section<Meshlet>(data, header, Section::Meshlets);
+  auto shortIndices = get_section<std::uint16_t>(data, header, Section::ShortIndices);
+
+  if (
+    !vertices || !indices || !relems || !meshes || !instanceMatrices || !instanceMeshes ||
+    !meshlets || !shortIndices)
+    return std::nullopt;
+
+  for (const auto& relem : *relems)
+  {
+    if (relem.indexFormat != IndexFormat::U32 && relem.indexFormat != IndexFormat::U16)
+    {
+      spdlog::error("Baked scene: a render element has an unknown index format");
+      return std::nullopt;
+    }
+
+    const std::size_t indexCount =
+      relem.indexFormat == IndexFormat::U16 ? shortIndices->size() : indices->size();
+
+    if (
+      relem.vertexOffset >= vertices->size() ||
+      std::uint64_t{relem.indexOffset} + relem.indexCount > indexCount ||
+      std::uint64_t{relem.firstMeshlet} + relem.meshletCount > meshlets->size())
+    {
+      spdlog::error("Baked scene: a render element references data out of bounds");
+      return std::nullopt;
+    }
+
+    for (const auto& lod : relem.lods)
+      if (std::uint64_t{lod.offset} + lod.count > indexCount)
+      {
+        spdlog::error("Baked scene: a render element LOD references indices out of bounds");
+        return std::nullopt;
+      }
+
+    for (const auto& meshlet : meshlets->subspan(relem.firstMeshlet, relem.meshletCount))
+      if (std::uint64_t{meshlet.indexOffset} + meshlet.indexCount > relem.indexCount)
+      {
+        spdlog::error("Baked scene: a meshlet references indices out of its render element");
+        return std::nullopt;
+      }
+  }
+
+  for (const auto& mesh : *meshes)
+    if (
+      std::uint64_t{mesh.firstRelem} + mesh.relemCount > relems->size() || mesh.lodCount == 0 ||
+      mesh.lodCount > MAX_LODS)
+    {
+      spdlog::error("Baked scene: a mesh references render elements or LODs out of bounds");
+      return std::nullopt;
+    }
+
+  if (instanceMatrices->size() != instanceMeshes->size())
+  {
+    spdlog::error("Baked scene: instance matrix and mesh counts differ");
+    return std::nullopt;
+  }
+
+  for (auto meshIdx : *instanceMeshes)
+    if (meshIdx >= meshes->size())
+    {
+      spdlog::error("Baked scene: an instance references a mesh out of bounds");
+      return std::nullopt;
+    }
+
+  return SceneView{
+    .vertices = *vertices,
+    .indices = *indices,
+    .shortIndices = *shortIndices,
+    .relems = *relems,
+    .meshes = *meshes,
+    .instanceMatrices = *instanceMatrices,
+    .instanceMeshes = *instanceMeshes,
+    .meshlets = *meshlets,
+  };
+}
+
+} // namespace baked
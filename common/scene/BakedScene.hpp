@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include <glm/glm.hpp>
+
+#include "scene/Meshlet.hpp"
+#include "scene/RenderElement.hpp"
+
+
+// Baked scenes are regular glTF files produced by model_bakery_baker, but their binary buffer
+// starts with a small header describing where GPU-ready data lives inside of it. This allows
+// the renderer to upload vertices and indices straight from a mapped file, without parsing
+// JSON or touching every vertex. No bufferView references the header, so glTF viewers
+// simply ignore it.
+namespace baked
+{
+
+inline constexpr std::uint32_t MAGIC = 0x4B424347; // "GCBK"
+inline constexpr std::uint32_t VERSION = 5;
+
+// Every section starts at an offset aligned to this
+inline constexpr std::size_t SECTION_ALIGNMENT = 16;
+
+// Vertex layout of baked scenes, see tasks/model_bakery/README.md
+struct Vertex
+{
+  glm::vec3 position;
+  // Signed normalized, 4th byte is padding
+  std::array<std::int8_t, 4> normal;
+  glm::vec2 texCoord;
+  // Signed normalized, 4th byte is the handedness required by glTF
+  std::array<std::int8_t, 4> tangent;
+  std::uint32_t padding;
+};
+
+static_assert(sizeof(Vertex) == 32);
+
+enum class Section : std::uint32_t
+{
+  Vertices,
+  Indices,
+  RenderElements,
+  Meshes,
+  InstanceMatrices,
+  InstanceMeshes,
+  Meshlets,
+  ShortIndices,
+
+  COUNT,
+};
+
+inline constexpr std::size_t SECTION_COUNT = static_cast<std::size_t>(Section::COUNT);
+
+struct SectionRange
+{
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct Header
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t vertexStride;
+  std::uint32_t sectionCount;
+  std::array<SectionRange, SECTION_COUNT> sections;
+};
+
+// Non-owning views into a baked scene binary
+struct SceneView
+{
+  std::span<const Vertex> vertices;
+  std::span<const std::uint32_t> indices;
+  std::span<const std::uint16_t> shortIndices;
+  std::span<const RenderElement> relems;
+  std::span<const Mesh> meshes;
+  std::span<const glm::mat4x4> instanceMatrices;
+  std::span<const std::uint32_t> instanceMeshes;
+  std::span<const Meshlet> meshlets;
+};
+
+// Validates the header and the cross-references between the (small) scene tables.
+// Vertex and index payloads are taken as is, checking them would mean touching every byte.
+std::optional<SceneView> parse(std::span<const std::byte> data);
+
+} // namespace baked
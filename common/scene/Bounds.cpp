@@ -0,0 +1,115 @@
+#include "Bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+
+namespace
+{
+
+Bounds empty_bounds()
+{
+  return Bounds{
+    .boxMin = glm::vec3(std::numeric_limits<float>::max()),
+    .boxMax = glm::vec3(std::numeric_limits<float>::lowest()),
+    .sphereCenter = glm::vec3(0.0f),
+    .sphereRadius = 0.0f,
+  };
+}
+
+bool is_empty(const Bounds& bounds)
+{
+  return bounds.boxMin.x > bounds.boxMax.x;
+}
+
+} // namespace
+
+Bounds compute_bounds(
+  std::span<const std::uint32_t> indices, const std::byte* vertices, std::size_t vertex_stride)
+{
+  auto result = empty_bounds();
+  if (indices.empty())
+    return result;
+
+  auto position = [vertices, vertex_stride](std::uint32_t index) {
+    glm::vec3 result;
+    std::memcpy(&result, vertices + index * vertex_stride, sizeof(result));
+    return result;
+  };
+
+  for (auto index : indices)
+  {
+    const auto pos = position(index);
+    result.boxMin = glm::min(result.boxMin, pos);
+    result.boxMax = glm::max(result.boxMax, pos);
+  }
+
+  // NOTE: the center of the box is not the optimal center of the sphere, but unlike
+  // the optimal one it is cheap to find and stable when the geometry changes a bit.
+  result.sphereCenter = (result.boxMin + result.boxMax) * 0.5f;
+
+  float maxDistance2 = 0;
+  for (auto index : indices)
+  {
+    const auto offset = position(index) - result.sphereCenter;
+    maxDistance2 = std::max(maxDistance2, glm::dot(offset, offset));
+  }
+  result.sphereRadius = std::sqrt(maxDistance2);
+
+  return result;
+}
+
+Bounds merge_bounds(std::span<const Bounds> bounds)
+{
+  auto result = empty_bounds();
+
+  for (const auto& part : bounds)
+  {
+    if (is_empty(part))
+      continue;
+    result.boxMin = glm::min(result.boxMin, part.boxMin);
+    result.boxMax = glm::max(result.boxMax, part.boxMax);
+  }
+
+  if (is_empty(result))
+    return result;
+
+  result.sphereCenter = (result.boxMin + result.boxMax) * 0.5f;
+  for (const auto& part : bounds)
+    if (!is_empty(part))
+      result.sphereRadius = std::max(
+        result.sphereRadius,
+        glm::length(part.sphereCenter - result.sphereCenter) + part.sphereRadius);
+
+  return result;
+}
+
+Bounds transform_bounds(const Bounds& bounds, const glm::mat4x4& transform)
+{
+  if (is_empty(bounds))
+    return bounds;
+
+  const glm::vec3 center = (bounds.boxMin + bounds.boxMax) * 0.5f;
+  const glm::vec3 extent = (bounds.boxMax - bounds.boxMin) * 0.5f;
+
+  // Every axis of the new box gets the projections of all of the old half-extents
+  const glm::vec3 newCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+  glm::vec3 newExtent{0.0f};
+  for (int i = 0; i < 3; ++i)
+    newExtent += glm::abs(glm::vec3(transform[i])) * extent[i];
+
+  // Non-uniform scale stretches the sphere into an ellipsoid, this is the sphere around it
+  const float maxScale = std::max(
+    {glm::length(glm::vec3(transform[0])),
+     glm::length(glm::vec3(transform[1])),
+     glm::length(glm::vec3(transform[2]))});
+
+  return Bounds{
+    .boxMin = newCenter - newExtent,
+    .boxMax = newCenter + newExtent,
+    .sphereCenter = glm::vec3(transform * glm::vec4(bounds.sphereCenter, 1.0f)),
+    .sphereRadius = bounds.sphereRadius * maxScale,
+  };
+}
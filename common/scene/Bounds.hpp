@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <glm/glm.hpp>
+
+
+// Axis-aligned box and sphere enclosing the same geometry. Both are kept, as the sphere
+// is cheaper to test while the box is tighter for long and flat objects.
+struct Bounds
+{
+  glm::vec3 boxMin;
+  glm::vec3 boxMax;
+  glm::vec3 sphereCenter;
+  float sphereRadius;
+};
+
+static_assert(sizeof(Bounds) == 40);
+
+// Bounds of the vertices referenced by the indices. Positions are 3 floats located at the
+// beginning of every vertex. No indices result in an empty box and a zero sphere at the origin.
+Bounds compute_bounds(
+  std::span<const std::uint32_t> indices, const std::byte* vertices, std::size_t vertex_stride);
+
+// Conservative bounds of the union, the sphere is centered at the center of the box
+Bounds merge_bounds(std::span<const Bounds> bounds);
+
+// Bounds of the transformed geometry, the box is that of the transformed box
+Bounds transform_bounds(const Bounds& bounds, const glm::mat4x4& transform);
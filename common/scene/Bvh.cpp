@@ -0,0 +1,376 @@
+#include "Bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <optional>
+
+
+namespace
+{
+
+// The heuristic is evaluated at the boundaries between bins of item centers
+constexpr std::size_t BIN_COUNT = 16;
+// Leaves can be bigger than this only if all of their items have the same center
+constexpr std::uint32_t MAX_LEAF_SIZE = 8;
+// Cost of visiting a node relative to testing an item
+constexpr float TRAVERSAL_COST = 1.0f;
+
+constexpr std::uint32_t NO_NODE = std::numeric_limits<std::uint32_t>::max();
+
+using Box = Bvh::Box;
+
+Box empty_box()
+{
+  return Box{
+    .min = glm::vec3(std::numeric_limits<float>::max()),
+    .max = glm::vec3(std::numeric_limits<float>::lowest()),
+  };
+}
+
+void grow(Box& box, const glm::vec3& point)
+{
+  box.min = glm::min(box.min, point);
+  box.max = glm::max(box.max, point);
+}
+
+void grow(Box& box, const Box& other)
+{
+  box.min = glm::min(box.min, other.min);
+  box.max = glm::max(box.max, other.max);
+}
+
+// Proportional to the probability of a random ray hitting the box
+float half_area(const Box& box)
+{
+  if (box.min.x > box.max.x)
+    return 0.0f;
+  const glm::vec3 size = box.max - box.min;
+  return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+enum class Containment
+{
+  Outside,
+  Intersects,
+  Inside,
+};
+
+Containment classify(const Frustum& frustum, const Box& box)
+{
+  const glm::vec3 center = (box.min + box.max) * 0.5f;
+  const glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+  auto result = Containment::Inside;
+  for (const auto& plane : frustum.planes)
+  {
+    const glm::vec3 normal{plane};
+    const float distance = glm::dot(normal, center) + plane.w;
+    const float radius = glm::dot(glm::abs(normal), extent);
+    if (distance + radius < 0.0f)
+      return Containment::Outside;
+    if (distance - radius < 0.0f)
+      result = Containment::Intersects;
+  }
+  return result;
+}
+
+struct BinnedSplit
+{
+  float cost;
+  int axis;
+  std::size_t bin;
+};
+
+} // namespace
+
+void Bvh::build(std::span<const Bounds> bounds)
+{
+  const auto count = static_cast<std::uint32_t>(bounds.size());
+
+  nodes.clear();
+  itemOrder.resize(count);
+  std::iota(itemOrder.begin(), itemOrder.end(), 0u);
+  itemBoxes.resize(count);
+  for (std::uint32_t i = 0; i < count; ++i)
+    itemBoxes[i] = Box{.min = bounds[i].boxMin, .max = bounds[i].boxMax};
+
+  if (count == 0)
+    return;
+
+  std::vector<glm::vec3> centers(count);
+  for (std::uint32_t i = 0; i < count; ++i)
+    centers[i] = (itemBoxes[i].min + itemBoxes[i].max) * 0.5f;
+
+  // Leaves hold at most MAX_LEAF_SIZE items but never zero,
+  // so the binary tree has at most 2n - 1 nodes
+  nodes.reserve(2 * std::size_t{count} - 1);
+
+  // NOTE: left children are processed right after their parents to keep the depth-first order,
+  // while right ones have to tell their parent where they ended up.
+  struct Task
+  {
+    std::uint32_t firstItem;
+    std::uint32_t itemCount;
+    std::uint32_t parentOfRight;
+  };
+  std::vector<Task> stack{Task{.firstItem = 0, .itemCount = count, .parentOfRight = NO_NODE}};
+
+  while (!stack.empty())
+  {
+    const auto task = stack.back();
+    stack.pop_back();
+
+    const auto nodeIdx = static_cast<std::uint32_t>(nodes.size());
+    if (task.parentOfRight != NO_NODE)
+      nodes[task.parentOfRight].rightChild = nodeIdx;
+
+    const auto items = std::span{itemOrder}.subspan(task.firstItem, task.itemCount);
+
+    Box box = empty_box();
+    Box centerBox = empty_box();
+    for (auto item : items)
+    {
+      grow(box, itemBoxes[item]);
+      grow(centerBox, centers[item]);
+    }
+
+    nodes.push_back(Node{
+      .box = box,
+      .firstItem = task.firstItem,
+      .itemCount = task.itemCount,
+      .rightChild = 0,
+    });
+
+    if (task.itemCount == 1)
+      continue;
+
+    auto binOf = [&centerBox, &centers](std::uint32_t item, int axis) {
+      const float extent = centerBox.max[axis] - centerBox.min[axis];
+      const float offset = (centers[item][axis] - centerBox.min[axis]) / extent;
+      return std::min(static_cast<std::size_t>(offset * BIN_COUNT), BIN_COUNT - 1);
+    };
+
+    // Costs are relative to the area of the node, splitting is worth it if it is cheaper
+    // than testing all items of a leaf
+    const float parentArea = std::max(half_area(box), std::numeric_limits<float>::min());
+    std::optional<BinnedSplit> best;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (!(centerBox.max[axis] > centerBox.min[axis]))
+        continue;
+
+      std::array<Box, BIN_COUNT> binBoxes;
+      binBoxes.fill(empty_box());
+      std::array<std::uint32_t, BIN_COUNT> binCounts{};
+      for (auto item : items)
+      {
+        const auto bin = binOf(item, axis);
+        grow(binBoxes[bin], itemBoxes[item]);
+        ++binCounts[bin];
+      }
+
+      // Right sides of every boundary, then a sweep from the left
+      std::array<float, BIN_COUNT> rightAreas{};
+      std::array<std::uint32_t, BIN_COUNT> rightCounts{};
+      Box rightBox = empty_box();
+      std::uint32_t rightCount = 0;
+      for (std::size_t bin = BIN_COUNT - 1; bin > 0; --bin)
+      {
+        grow(rightBox, binBoxes[bin]);
+        rightCount += binCounts[bin];
+        rightAreas[bin] = half_area(rightBox);
+        rightCounts[bin] = rightCount;
+      }
+
+      Box leftBox = empty_box();
+      std::uint32_t leftCount = 0;
+      for (std::size_t bin = 0; bin + 1 < BIN_COUNT; ++bin)
+      {
+        grow(leftBox, binBoxes[bin]);
+        leftCount += binCounts[bin];
+        if (leftCount == 0 || rightCounts[bin + 1] == 0)
+          continue;
+
+        const float cost = TRAVERSAL_COST +
+          (half_area(leftBox) * static_cast<float>(leftCount) +
+           rightAreas[bin + 1] * static_cast<float>(rightCounts[bin + 1])) /
+            parentArea;
+        if (!best.has_value() || cost < best->cost)
+          best = BinnedSplit{.cost = cost, .axis = axis, .bin = bin};
+      }
+    }
+
+    std::uint32_t leftCount = 0;
+    if (best.has_value())
+    {
+      if (best->cost >= static_cast<float>(task.itemCount) && task.itemCount <= MAX_LEAF_SIZE)
+        continue;
+
+      const auto middle = std::partition(items.begin(), items.end(), [&](std::uint32_t item) {
+        return binOf(item, best->axis) <= best->bin;
+      });
+      leftCount = static_cast<std::uint32_t>(middle - items.begin());
+    }
+    else
+    {
+      // All centers coincide, nothing to choose between
+      if (task.itemCount <= MAX_LEAF_SIZE)
+        continue;
+      leftCount = task.itemCount / 2;
+    }
+
+    stack.push_back(Task{
+      .firstItem = task.firstItem + leftCount,
+      .itemCount = task.itemCount - leftCount,
+      .parentOfRight = nodeIdx,
+    });
+    stack.push_back(Task{
+      .firstItem = task.firstItem,
+      .itemCount = leftCount,
+      .parentOfRight = NO_NODE,
+    });
+  }
+}
+
+void Bvh::refit(std::span<const Bounds> bounds)
+{
+  for (std::size_t i = 0; i < itemBoxes.size(); ++i)
+    itemBoxes[i] = Box{.min = bounds[i].boxMin, .max = bounds[i].boxMax};
+
+  // Children always follow their parents, so going backwards updates them first
+  for (std::size_t i = nodes.size(); i-- > 0;)
+  {
+    auto& node = nodes[i];
+
+    Box box = empty_box();
+    if (node.rightChild == 0)
+      for (std::uint32_t j = 0; j < node.itemCount; ++j)
+        grow(box, itemBoxes[itemOrder[node.firstItem + j]]);
+    else
+      for (const auto* child : {&nodes[i + 1], &nodes[node.rightChild]})
+        grow(box, child->box);
+
+    node.box = box;
+  }
+}
+
+void Bvh::appendItems(const Node& node, std::vector<std::uint32_t>& result) const
+{
+  const auto first = itemOrder.begin() + node.firstItem;
+  result.insert(result.end(), first, first + node.itemCount);
+}
+
+void Bvh::cullFrustum(const Frustum& frustum, std::vector<std::uint32_t>& result) const
+{
+  if (nodes.empty())
+    return;
+
+  std::vector<std::uint32_t> stack{0};
+  while (!stack.empty())
+  {
+    const auto nodeIdx = stack.back();
+    const auto& node = nodes[nodeIdx];
+    stack.pop_back();
+
+    switch (classify(frustum, node.box))
+    {
+    case Containment::Outside:
+      break;
+    case Containment::Inside:
+      appendItems(node, result);
+      break;
+    case Containment::Intersects:
+      if (node.rightChild != 0)
+      {
+        stack.push_back(node.rightChild);
+        stack.push_back(nodeIdx + 1);
+        break;
+      }
+      for (std::uint32_t j = 0; j < node.itemCount; ++j)
+      {
+        const auto item = itemOrder[node.firstItem + j];
+        if (classify(frustum, itemBoxes[item]) != Containment::Outside)
+          result.push_back(item);
+      }
+      break;
+    }
+  }
+}
+
+template <class Overlaps>
+void Bvh::query(const Overlaps& overlaps, std::vector<std::uint32_t>& result) const
+{
+  if (nodes.empty())
+    return;
+
+  std::vector<std::uint32_t> stack{0};
+  while (!stack.empty())
+  {
+    const auto nodeIdx = stack.back();
+    const auto& node = nodes[nodeIdx];
+    stack.pop_back();
+
+    if (!overlaps(node.box))
+      continue;
+
+    if (node.rightChild != 0)
+    {
+      stack.push_back(node.rightChild);
+      stack.push_back(nodeIdx + 1);
+      continue;
+    }
+
+    for (std::uint32_t j = 0; j < node.itemCount; ++j)
+    {
+      const auto item = itemOrder[node.firstItem + j];
+      if (overlaps(itemBoxes[item]))
+        result.push_back(item);
+    }
+  }
+}
+
+void Bvh::queryBox(
+  const glm::vec3& box_min, const glm::vec3& box_max, std::vector<std::uint32_t>& result) const
+{
+  query(
+    [&](const Box& box) {
+      return glm::all(glm::lessThanEqual(box.min, box_max)) &&
+        glm::all(glm::lessThanEqual(box_min, box.max));
+    },
+    result);
+}
+
+void Bvh::querySphere(
+  const glm::vec3& center, float radius, std::vector<std::uint32_t>& result) const
+{
+  query(
+    [&](const Box& box) {
+      const glm::vec3 offset = glm::clamp(center, box.min, box.max) - center;
+      return glm::dot(offset, offset) <= radius * radius;
+    },
+    result);
+}
+
+void Bvh::queryRay(
+  const glm::vec3& origin,
+  const glm::vec3& direction,
+  float max_distance,
+  std::vector<std::uint32_t>& result) const
+{
+  // NOTE: zero components turn into infinities, which the slab test handles as is
+  const glm::vec3 invDirection = 1.0f / direction;
+  query(
+    [&](const Box& box) {
+      const glm::vec3 t0 = (box.min - origin) * invDirection;
+      const glm::vec3 t1 = (box.max - origin) * invDirection;
+      const glm::vec3 near = glm::min(t0, t1);
+      const glm::vec3 far = glm::max(t0, t1);
+      const float enter = std::max({near.x, near.y, near.z, 0.0f});
+      const float exit = std::min({far.x, far.y, far.z, max_distance});
+      return enter <= exit;
+    },
+    result);
+}
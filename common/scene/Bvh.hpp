@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene/Bounds.hpp"
+#include "scene/FrustumCulling.hpp"
+
+
+/**
+ * Bounding volume hierarchy over boxes of items, e.g. world bounds of instances.
+ * It is built with the surface area heuristic evaluated over a fixed amount of bins,
+ * which is O(n log n) and produces trees close to those of the exact heuristic.
+ *
+ * Nodes are stored in depth-first order, so the left child of a node immediately follows it,
+ * and every subtree covers a contiguous range of items, so whole subtrees can be accepted
+ * without visiting them. Queries append indices of items in no particular order.
+ */
+class Bvh
+{
+public:
+  struct Box
+  {
+    glm::vec3 min;
+    glm::vec3 max;
+  };
+
+  void build(std::span<const Bounds> bounds);
+
+  // Updates boxes for moved items while keeping the tree, the amount of items must not change.
+  // NOTE: the tree degrades as items travel far from where they were at build time.
+  void refit(std::span<const Bounds> bounds);
+
+  std::size_t size() const { return itemBoxes.size(); }
+
+  // Items with boxes intersecting the frustum
+  void cullFrustum(const Frustum& frustum, std::vector<std::uint32_t>& result) const;
+  // Items with boxes overlapping the box
+  void queryBox(
+    const glm::vec3& box_min, const glm::vec3& box_max, std::vector<std::uint32_t>& result) const;
+  // Items with boxes overlapping the sphere
+  void querySphere(
+    const glm::vec3& center, float radius, std::vector<std::uint32_t>& result) const;
+  // Items with boxes hit by the ray before max_distance, direction doesn't have to be normalized
+  // in which case the distance is measured in its lengths
+  void queryRay(
+    const glm::vec3& origin,
+    const glm::vec3& direction,
+    float max_distance,
+    std::vector<std::uint32_t>& result) const;
+
+private:
+  struct Node
+  {
+    Box box;
+    // Range of items in itemOrder covered by the subtree
+    std::uint32_t firstItem;
+    std::uint32_t itemCount;
+    // The left child is the next node, 0 means that this is a leaf
+    std::uint32_t rightChild;
+  };
+
+  void appendItems(const Node& node, std::vector<std::uint32_t>& result) const;
+
+  // Visits nodes for which the predicate holds, collecting items from leaves with it
+  // being true for their boxes as well
+  template <class Overlaps>
+  void query(const Overlaps& overlaps, std::vector<std::uint32_t>& result) const;
+
+private:
+  std::vector<Node> nodes;
+  std::vector<std::uint32_t> itemOrder;
+  std::vector<Box> itemBoxes;
+};
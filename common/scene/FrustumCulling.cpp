@@ -0,0 +1,224 @@
+#include "FrustumCulling.hpp"
+
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+
+namespace
+{
+
+constexpr std::size_t BATCH_SIZE = CullingBoxes::BATCH_SIZE;
+
+// Plane coefficients broadcast for the batch, the absolute values of the normal
+// project half-extents onto it, which gives the distance of the box corner
+// closest to the inside of the plane.
+struct SplatPlane
+{
+  float nx, ny, nz, d;
+  float ax, ay, az;
+};
+
+SplatPlane splat_plane(const glm::vec4& plane)
+{
+  return SplatPlane{
+    .nx = plane.x,
+    .ny = plane.y,
+    .nz = plane.z,
+    .d = plane.w,
+    .ax = std::abs(plane.x),
+    .ay = std::abs(plane.y),
+    .az = std::abs(plane.z),
+  };
+}
+
+// Bit i of the result is set if box first + i is not outside of any plane
+std::uint32_t test_batch(
+  const std::array<SplatPlane, 6>& planes,
+  const std::array<const float*, 3>& centers,
+  const std::array<const float*, 3>& extents,
+  std::size_t first)
+{
+#if defined(__AVX2__)
+  const __m256 cx = _mm256_loadu_ps(centers[0] + first);
+  const __m256 cy = _mm256_loadu_ps(centers[1] + first);
+  const __m256 cz = _mm256_loadu_ps(centers[2] + first);
+  const __m256 ex = _mm256_loadu_ps(extents[0] + first);
+  const __m256 ey = _mm256_loadu_ps(extents[1] + first);
+  const __m256 ez = _mm256_loadu_ps(extents[2] + first);
+
+  __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  for (const auto& plane : planes)
+  {
+    __m256 distance = _mm256_set1_ps(plane.d);
+    distance = _mm256_add_ps(distance, _mm256_mul_ps(cx, _mm256_set1_ps(plane.nx)));
+    distance = _mm256_add_ps(distance, _mm256_mul_ps(cy, _mm256_set1_ps(plane.ny)));
+    distance = _mm256_add_ps(distance, _mm256_mul_ps(cz, _mm256_set1_ps(plane.nz)));
+    distance = _mm256_add_ps(distance, _mm256_mul_ps(ex, _mm256_set1_ps(plane.ax)));
+    distance = _mm256_add_ps(distance, _mm256_mul_ps(ey, _mm256_set1_ps(plane.ay)));
+    distance = _mm256_add_ps(distance, _mm256_mul_ps(ez, _mm256_set1_ps(plane.az)));
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+  }
+  return static_cast<std::uint32_t>(_mm256_movemask_ps(inside));
+#elif defined(__SSE2__) || defined(_M_X64)
+  static_assert(BATCH_SIZE % 4 == 0);
+  std::uint32_t result = 0;
+  for (std::size_t i = 0; i < BATCH_SIZE; i += 4)
+  {
+    const __m128 cx = _mm_loadu_ps(centers[0] + first + i);
+    const __m128 cy = _mm_loadu_ps(centers[1] + first + i);
+    const __m128 cz = _mm_loadu_ps(centers[2] + first + i);
+    const __m128 ex = _mm_loadu_ps(extents[0] + first + i);
+    const __m128 ey = _mm_loadu_ps(extents[1] + first + i);
+    const __m128 ez = _mm_loadu_ps(extents[2] + first + i);
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const auto& plane : planes)
+    {
+      __m128 distance = _mm_set1_ps(plane.d);
+      distance = _mm_add_ps(distance, _mm_mul_ps(cx, _mm_set1_ps(plane.nx)));
+      distance = _mm_add_ps(distance, _mm_mul_ps(cy, _mm_set1_ps(plane.ny)));
+      distance = _mm_add_ps(distance, _mm_mul_ps(cz, _mm_set1_ps(plane.nz)));
+      distance = _mm_add_ps(distance, _mm_mul_ps(ex, _mm_set1_ps(plane.ax)));
+      distance = _mm_add_ps(distance, _mm_mul_ps(ey, _mm_set1_ps(plane.ay)));
+      distance = _mm_add_ps(distance, _mm_mul_ps(ez, _mm_set1_ps(plane.az)));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+    }
+    result |= static_cast<std::uint32_t>(_mm_movemask_ps(inside)) << i;
+  }
+  return result;
+#else
+  std::uint32_t result = 0;
+  for (std::size_t i = 0; i < BATCH_SIZE; ++i)
+  {
+    bool inside = true;
+    for (const auto& plane : planes)
+    {
+      const float distance = plane.d + centers[0][first + i] * plane.nx +
+        centers[1][first + i] * plane.ny + centers[2][first + i] * plane.nz +
+        extents[0][first + i] * plane.ax + extents[1][first + i] * plane.ay +
+        extents[2][first + i] * plane.az;
+      inside = inside && distance >= 0.0f;
+    }
+    result |= static_cast<std::uint32_t>(inside) << i;
+  }
+  return result;
+#endif
+}
+
+} // namespace
+
+Frustum extract_frustum(const glm::mat4x4& view_proj)
+{
+  // Clip space position is (dot(row0, p), ..., dot(row3, p)), so every clip space
+  // inequality like -w <= x turns into a plane in world space.
+  const glm::mat4x4 rows = glm::transpose(view_proj);
+  return Frustum{
+    .planes = {
+      rows[3] + rows[0],
+      rows[3] - rows[0],
+      rows[3] + rows[1],
+      rows[3] - rows[1],
+      rows[2],
+      rows[3] - rows[2],
+    }};
+}
+
+glm::mat4x4 crop_to_receivers(
+  const glm::mat4x4& light_view_proj, const glm::mat4x4& camera_view_proj, float extension)
+{
+  glm::vec3 receiversMin{-1.0f, -1.0f, 0.0f};
+  glm::vec3 receiversMax{1.0f, 1.0f, 1.0f};
+
+  // Both projections keep the camera frustum convex while it is in front of the light,
+  // so the bounds of its corners in light space are the bounds of the whole of it
+  const glm::mat4x4 cameraToWorld = glm::inverse(camera_view_proj);
+  glm::vec3 cornersMin{std::numeric_limits<float>::max()};
+  glm::vec3 cornersMax{std::numeric_limits<float>::lowest()};
+  bool bounded = true;
+  for (int i = 0; i < 8; ++i)
+  {
+    const glm::vec4 corner{i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : 0.0f, 1.0f};
+    const glm::vec4 world = cameraToWorld * corner;
+    const glm::vec4 light = light_view_proj * (world / world.w);
+    bounded = bounded && light.w > 0.0f;
+    cornersMin = glm::min(cornersMin, glm::vec3(light) / light.w);
+    cornersMax = glm::max(cornersMax, glm::vec3(light) / light.w);
+  }
+
+  if (bounded)
+  {
+    // Receivers past the far plane of the light are not in the shadow map anyway
+    receiversMin = glm::clamp(cornersMin, receiversMin, receiversMax);
+    receiversMax = glm::clamp(cornersMax, receiversMin, receiversMax);
+  }
+
+  // NOTE: an empty overlap still gets a tiny frustum, which hardly anything gets into
+  const glm::vec2 size = glm::max(glm::vec2(receiversMax - receiversMin), glm::vec2(1e-4f));
+  const glm::vec2 center = (glm::vec2(receiversMax) + glm::vec2(receiversMin)) * 0.5f;
+  const float depth = receiversMax.z + extension;
+
+  // Maps the receivers to [-1, 1] in x and y, and [-extension, receiversMax.z] to [0, 1] in z
+  glm::mat4x4 crop{1.0f};
+  crop[0][0] = 2.0f / size.x;
+  crop[1][1] = 2.0f / size.y;
+  crop[2][2] = 1.0f / depth;
+  crop[3][0] = -center.x * crop[0][0];
+  crop[3][1] = -center.y * crop[1][1];
+  crop[3][2] = extension / depth;
+  return crop * light_view_proj;
+}
+
+void CullingBoxes::resize(std::size_t new_count)
+{
+  count = new_count;
+
+  const std::size_t padded = (count + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+  for (auto& values : centers)
+    values.resize(padded, 0.0f);
+  for (auto& values : extents)
+    values.resize(padded, 0.0f);
+}
+
+void CullingBoxes::set(std::size_t idx, const Bounds& bounds)
+{
+  const glm::vec3 center = (bounds.boxMin + bounds.boxMax) * 0.5f;
+  const glm::vec3 extent = (bounds.boxMax - bounds.boxMin) * 0.5f;
+  for (int i = 0; i < 3; ++i)
+  {
+    centers[i][idx] = center[i];
+    extents[i][idx] = extent[i];
+  }
+}
+
+void cull_boxes(
+  const Frustum& frustum, const CullingBoxes& boxes, std::vector<std::uint32_t>& visible)
+{
+  std::array<SplatPlane, 6> planes;
+  for (std::size_t i = 0; i < planes.size(); ++i)
+    planes[i] = splat_plane(frustum.planes[i]);
+
+  const std::array<const float*, 3> centers{
+    boxes.centers[0].data(), boxes.centers[1].data(), boxes.centers[2].data()};
+  const std::array<const float*, 3> extents{
+    boxes.extents[0].data(), boxes.extents[1].data(), boxes.extents[2].data()};
+
+  for (std::size_t first = 0; first < boxes.count; first += BATCH_SIZE)
+  {
+    std::uint32_t mask = test_batch(planes, centers, extents, first);
+
+    // Padding past the last box must not end up in the output
+    if (const std::size_t remaining = boxes.count - first; remaining < BATCH_SIZE)
+      mask &= (1u << remaining) - 1;
+
+    while (mask != 0)
+    {
+      visible.push_back(static_cast<std::uint32_t>(first + std::countr_zero(mask)));
+      mask &= mask - 1;
+    }
+  }
+}
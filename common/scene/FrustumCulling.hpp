@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene/Bounds.hpp"
+
+
+// Planes point inwards: a point p is inside if dot(plane.xyz, p) + plane.w >= 0 for all of them
+struct Frustum
+{
+  std::array<glm::vec4, 6> planes;
+};
+
+// Extracts the planes of a projection with depth in [0, 1], as used by Vulkan.
+// Planes are not normalized, as that doesn't change which side of them a box is on.
+Frustum extract_frustum(const glm::mat4x4& view_proj);
+
+// Crops the clip space of a light to the part of it that the camera sees, so that the frustum
+// of the result only holds casters with shadows that may be visible. It keeps everything up to
+// `extension` depths of the light frustum in front of it, as casters behind the near plane
+// still shadow the receivers. Falls back to the whole light frustum when some of the camera
+// frustum is behind a perspective light, which makes its projection unbounded.
+glm::mat4x4 crop_to_receivers(
+  const glm::mat4x4& light_view_proj, const glm::mat4x4& camera_view_proj, float extension);
+
+/**
+ * Axis-aligned boxes stored as a structure of arrays of centers and half-extents, so that
+ * a whole batch of boxes is tested against a plane with a few SIMD instructions.
+ * Arrays are padded to a multiple of the batch size, which keeps loads in bounds.
+ */
+class CullingBoxes
+{
+public:
+  static constexpr std::size_t BATCH_SIZE = 8;
+
+  void resize(std::size_t count);
+  std::size_t size() const { return count; }
+
+  void set(std::size_t idx, const Bounds& bounds);
+
+private:
+  friend void cull_boxes(
+    const Frustum& frustum, const CullingBoxes& boxes, std::vector<std::uint32_t>& visible);
+
+  std::size_t count = 0;
+  std::array<std::vector<float>, 3> centers;
+  std::array<std::vector<float>, 3> extents;
+};
+
+// Appends indices of boxes that intersect the frustum to `visible` in increasing order.
+// NOTE: boxes that only intersect the planes outside of the frustum pass as well,
+// which is conservative and rare enough to not matter.
+void cull_boxes(
+  const Frustum& frustum, const CullingBoxes& boxes, std::vector<std::uint32_t>& visible);
@@ -0,0 +1,145 @@
+#include "GltfInstances.hpp"
+
+#include <queue>
+#include <utility>
+
+#include <glm/gtc/quaternion.hpp>
+
+
+namespace
+{
+
+struct LocalTransform
+{
+  glm::vec3 translation{0.0f};
+  glm::quat rotation{1.0f, 0.0f, 0.0f, 0.0f};
+  glm::vec3 scale{1.0f};
+};
+
+glm::vec3 to_vec3(const std::vector<double>& values)
+{
+  return glm::vec3(
+    static_cast<float>(values[0]), static_cast<float>(values[1]), static_cast<float>(values[2]));
+}
+
+// NOTE: glTF only allows matrices without shear, so these decompose into TRS exactly
+LocalTransform decompose(const std::vector<double>& values)
+{
+  glm::mat4x4 matrix;
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j)
+      matrix[i][j] = static_cast<float>(values[4 * i + j]);
+
+  LocalTransform result;
+  result.translation = glm::vec3(matrix[3]);
+
+  glm::mat3x3 basis{glm::vec3(matrix[0]), glm::vec3(matrix[1]), glm::vec3(matrix[2])};
+  for (int i = 0; i < 3; ++i)
+    result.scale[i] = glm::length(basis[i]);
+
+  // A mirroring matrix is represented with a negative scale along x
+  if (glm::dot(glm::cross(basis[0], basis[1]), basis[2]) < 0.0f)
+    result.scale.x = -result.scale.x;
+
+  // Degenerate scales leave no rotation to extract, the world matrix is flat anyway
+  if (result.scale.x == 0.0f || result.scale.y == 0.0f || result.scale.z == 0.0f)
+    return result;
+
+  for (int i = 0; i < 3; ++i)
+    basis[i] /= result.scale[i];
+  result.rotation = glm::normalize(glm::quat_cast(basis));
+
+  return result;
+}
+
+LocalTransform get_local_transform(const tinygltf::Node& node)
+{
+  if (!node.matrix.empty())
+    return decompose(node.matrix);
+
+  LocalTransform result;
+  if (!node.translation.empty())
+    result.translation = to_vec3(node.translation);
+  if (!node.rotation.empty())
+    result.rotation = glm::quat(
+      static_cast<float>(node.rotation[3]),
+      static_cast<float>(node.rotation[0]),
+      static_cast<float>(node.rotation[1]),
+      static_cast<float>(node.rotation[2]));
+  if (!node.scale.empty())
+    result.scale = to_vec3(node.scale);
+  return result;
+}
+
+} // namespace
+
+GltfHierarchy build_hierarchy(const tinygltf::Model& model)
+{
+  std::vector<std::uint32_t> parents;
+  std::vector<glm::vec3> translations;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+
+  GltfHierarchy result;
+
+  if (model.scenes.empty())
+    return result;
+
+  // NOTE: glTF leaves the choice to the application when there is no default scene
+  const auto& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+
+  // Breadth-first order places every level of the tree after the previous one
+  struct QueuedNode
+  {
+    int gltfNode;
+    std::uint32_t parent;
+  };
+  std::queue<QueuedNode> queue;
+  for (auto root : scene.nodes)
+    queue.push(QueuedNode{.gltfNode = root, .parent = TransformHierarchy::NO_PARENT});
+
+  while (!queue.empty())
+  {
+    const auto [gltfNode, parent] = queue.front();
+    queue.pop();
+
+    const auto& node = model.nodes[gltfNode];
+    const auto nodeIdx = static_cast<std::uint32_t>(parents.size());
+
+    const auto local = get_local_transform(node);
+    parents.push_back(parent);
+    translations.push_back(local.translation);
+    rotations.push_back(local.rotation);
+    scales.push_back(local.scale);
+
+    if (node.mesh >= 0)
+    {
+      result.instanceNodes.push_back(nodeIdx);
+      result.instanceMeshes.push_back(static_cast<std::uint32_t>(node.mesh));
+    }
+
+    for (auto child : node.children)
+      queue.push(QueuedNode{.gltfNode = child, .parent = nodeIdx});
+  }
+
+  result.hierarchy = TransformHierarchy(
+    std::move(parents), std::move(translations), std::move(rotations), std::move(scales));
+
+  return result;
+}
+
+GltfInstances flatten_instances(const tinygltf::Model& model)
+{
+  auto [hierarchy, instanceNodes, instanceMeshes] = build_hierarchy(model);
+  hierarchy.update();
+
+  const auto worldMatrices = hierarchy.getWorldMatrices();
+
+  GltfInstances result;
+  result.matrices.reserve(instanceNodes.size());
+  for (auto node : instanceNodes)
+    result.matrices.push_back(worldMatrices[node]);
+  result.meshes = std::move(instanceMeshes);
+
+  return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include "scene/TransformHierarchy.hpp"
+
+
+// Nodes of the default scene, reordered breadth-first as required by TransformHierarchy.
+// Every node with a mesh becomes an instance: the mesh drawn with the node's world transform.
+struct GltfHierarchy
+{
+  TransformHierarchy hierarchy;
+  std::vector<std::uint32_t> instanceNodes;
+  std::vector<std::uint32_t> instanceMeshes;
+};
+
+GltfHierarchy build_hierarchy(const tinygltf::Model& model);
+
+struct GltfInstances
+{
+  std::vector<glm::mat4x4> matrices;
+  std::vector<std::uint32_t> meshes;
+};
+
+// Same instances as above with their world transforms baked in
+GltfInstances flatten_instances(const tinygltf::Model& model);
@@ -0,0 +1,145 @@
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+std::optional<MappedFile> MappedFile::open(const std::filesystem::path& path)
+{
+  MappedFile result;
+
+#ifdef _WIN32
+  result.fileHandle = CreateFileW(
+    path.c_str(),
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    nullptr,
+    OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+    nullptr);
+  if (result.fileHandle == INVALID_HANDLE_VALUE)
+  {
+    result.fileHandle = nullptr;
+    spdlog::error("Unable to open '{}' for mapping", path);
+    return std::nullopt;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (GetFileSizeEx(result.fileHandle, &fileSize) == 0 || fileSize.QuadPart == 0)
+  {
+    spdlog::error("Unable to map '{}', the file is empty or inaccessible", path);
+    return std::nullopt;
+  }
+  result.size = static_cast<std::size_t>(fileSize.QuadPart);
+
+  result.mappingHandle =
+    CreateFileMappingW(result.fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (result.mappingHandle == nullptr)
+  {
+    spdlog::error("Unable to map '{}'", path);
+    return std::nullopt;
+  }
+
+  result.ptr =
+    static_cast<std::byte*>(MapViewOfFile(result.mappingHandle, FILE_MAP_READ, 0, 0, 0));
+  if (result.ptr == nullptr)
+  {
+    spdlog::error("Unable to map '{}'", path);
+    return std::nullopt;
+  }
+#else
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    spdlog::error("Unable to open '{}' for mapping", path);
+    return std::nullopt;
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+  {
+    ::close(fd);
+    spdlog::error("Unable to map '{}', the file is empty or inaccessible", path);
+    return std::nullopt;
+  }
+  result.size = static_cast<std::size_t>(fileStat.st_size);
+
+  void* mapping = mmap(nullptr, result.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // NOTE: the mapping keeps the file alive by itself
+  ::close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    spdlog::error("Unable to map '{}'", path);
+    return std::nullopt;
+  }
+
+  // We are going to stream through the whole file exactly once
+  madvise(mapping, result.size, MADV_SEQUENTIAL);
+
+  result.ptr = static_cast<std::byte*>(mapping);
+#endif
+
+  return result;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : ptr{std::exchange(other.ptr, nullptr)}
+  , size{std::exchange(other.size, 0)}
+#ifdef _WIN32
+  , fileHandle{std::exchange(other.fileHandle, nullptr)}
+  , mappingHandle{std::exchange(other.mappingHandle, nullptr)}
+#endif
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this == &other)
+    return *this;
+
+  close();
+  ptr = std::exchange(other.ptr, nullptr);
+  size = std::exchange(other.size, 0);
+#ifdef _WIN32
+  fileHandle = std::exchange(other.fileHandle, nullptr);
+  mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#endif
+  return *this;
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+  if (ptr != nullptr)
+    UnmapViewOfFile(ptr);
+  if (mappingHandle != nullptr)
+    CloseHandle(mappingHandle);
+  if (fileHandle != nullptr)
+    CloseHandle(fileHandle);
+  fileHandle = nullptr;
+  mappingHandle = nullptr;
+#else
+  if (ptr != nullptr)
+    munmap(ptr, size);
+#endif
+  ptr = nullptr;
+  size = 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+
+/**
+ * Read-only memory mapping of a whole file. Pages are loaded by the OS on first
+ * access, so reading through the mapping costs no more than the disc read itself
+ * and doesn't need any intermediate buffers.
+ */
+class MappedFile
+{
+public:
+  static std::optional<MappedFile> open(const std::filesystem::path& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  ~MappedFile();
+
+  std::span<const std::byte> data() const { return {ptr, size}; }
+
+private:
+  MappedFile() = default;
+  void close();
+
+private:
+  std::byte* ptr = nullptr;
+  std::size_t size = 0;
+#ifdef _WIN32
+  void* fileHandle = nullptr;
+  void* mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,134 @@
+#include "Meshlet.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+
+namespace
+{
+
+glm::vec3 load_position(const std::byte* vertices, std::size_t vertex_stride, std::uint32_t index)
+{
+  glm::vec3 result;
+  std::memcpy(&result, vertices + index * vertex_stride, sizeof(result));
+  return result;
+}
+
+Meshlet compute_bounds(
+  std::span<const std::uint32_t> indices, const std::byte* vertices, std::size_t vertex_stride)
+{
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+  for (auto index : indices)
+  {
+    const auto position = load_position(vertices, vertex_stride, index);
+    min = glm::min(min, position);
+    max = glm::max(max, position);
+  }
+
+  const glm::vec3 center = (min + max) * 0.5f;
+  float radius = 0;
+  for (auto index : indices)
+    radius = std::max(radius, glm::length(load_position(vertices, vertex_stride, index) - center));
+
+  std::vector<glm::vec3> normals;
+  normals.reserve(indices.size() / 3);
+  glm::vec3 axis{0};
+  for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+  {
+    const auto a = load_position(vertices, vertex_stride, indices[i + 0]);
+    const auto b = load_position(vertices, vertex_stride, indices[i + 1]);
+    const auto c = load_position(vertices, vertex_stride, indices[i + 2]);
+
+    const glm::vec3 normal = glm::cross(b - a, c - a);
+    const float length = glm::length(normal);
+    // NOTE: degenerate triangles are invisible, so they don't restrict the cone
+    if (length <= 0.0f)
+      continue;
+
+    normals.push_back(normal / length);
+    axis += normals.back();
+  }
+
+  // A cutoff of 1 never passes the culling test
+  float coneCutoff = 1.0f;
+  const float axisLength = glm::length(axis);
+  if (axisLength > 0.0f)
+  {
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const auto& normal : normals)
+      minDot = std::min(minDot, glm::dot(normal, axis));
+
+    // NOTE: cones wider than a hemisphere are always visible from somewhere
+    if (minDot > 0.0f)
+      coneCutoff = std::sqrt(1.0f - minDot * minDot);
+  }
+
+  return Meshlet{
+    .center = center,
+    .radius = radius,
+    .coneAxis = axis,
+    .coneCutoff = coneCutoff,
+    .indexOffset = 0,
+    .indexCount = static_cast<std::uint32_t>(indices.size()),
+    .vertexCount = 0,
+    .padding = 0,
+  };
+}
+
+} // namespace
+
+std::vector<Meshlet> build_meshlets(
+  std::span<const std::uint32_t> indices,
+  const std::byte* vertices,
+  std::size_t vertex_stride,
+  std::size_t vertex_count)
+{
+  std::vector<Meshlet> result;
+
+  // Tags every vertex with the meshlet it was last seen in
+  std::vector<std::uint32_t> seenIn(vertex_count, std::numeric_limits<std::uint32_t>::max());
+
+  std::size_t begin = 0;
+  std::size_t uniqueVertices = 0;
+
+  auto flush = [&](std::size_t end) {
+    auto& meshlet = result.emplace_back(
+      compute_bounds(indices.subspan(begin, end - begin), vertices, vertex_stride));
+    meshlet.indexOffset = static_cast<std::uint32_t>(begin);
+    meshlet.vertexCount = static_cast<std::uint32_t>(uniqueVertices);
+    begin = end;
+    uniqueVertices = 0;
+  };
+
+  for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+  {
+    const auto current = static_cast<std::uint32_t>(result.size());
+
+    std::size_t newVertices = 0;
+    for (std::size_t k = 0; k < 3; ++k)
+      if (seenIn[indices[i + k]] != current)
+        ++newVertices;
+
+    // NOTE: duplicate indices within a triangle are over-counted here, which is harmless
+    if (
+      uniqueVertices + newVertices > MESHLET_MAX_VERTICES ||
+      (i - begin) / 3 + 1 > MESHLET_MAX_TRIANGLES)
+      flush(i);
+
+    const auto meshletIdx = static_cast<std::uint32_t>(result.size());
+    for (std::size_t k = 0; k < 3; ++k)
+      if (std::exchange(seenIn[indices[i + k]], meshletIdx) != meshletIdx)
+        ++uniqueVertices;
+  }
+
+  if (begin + 2 < indices.size())
+    flush(indices.size() - indices.size() % 3);
+
+  return result;
+}
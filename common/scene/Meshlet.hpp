@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+inline constexpr std::size_t MESHLET_MAX_VERTICES = 64;
+inline constexpr std::size_t MESHLET_MAX_TRIANGLES = 124;
+
+// A meshlet is a small cluster of a relem's triangles that is culled as a whole.
+// Triangles of a meshlet are contiguous in the index buffer, so a visible
+// meshlet is simply drawn with the relem's vertex offset.
+struct Meshlet
+{
+  // Bounding sphere in mesh space
+  glm::vec3 center;
+  float radius;
+
+  // All triangles of the meshlet are back-facing and can be skipped if
+  // dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius
+  glm::vec3 coneAxis;
+  float coneCutoff;
+
+  // Relative to the first index of the relem
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+  std::uint32_t vertexCount;
+  std::uint32_t padding;
+};
+
+static_assert(sizeof(Meshlet) == 48);
+
+// Splits a relem into meshlets of at most MESHLET_MAX_VERTICES unique vertices and
+// MESHLET_MAX_TRIANGLES triangles without reordering the indices. The indices should
+// already be in vertex cache friendly order, which keeps the meshlets spatially compact.
+// Positions are 3 floats located at the beginning of every vertex.
+std::vector<Meshlet> build_meshlets(
+  std::span<const std::uint32_t> indices,
+  const std::byte* vertices,
+  std::size_t vertex_stride,
+  std::size_t vertex_count);
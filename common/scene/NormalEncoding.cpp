@@ -0,0 +1,50 @@
+#include "NormalEncoding.hpp"
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+
+std::uint32_t encode_normal(glm::vec3 normal)
+{
+  const std::int32_t x = static_cast<std::int32_t>(normal.x * 32767.0f);
+  const std::int32_t y = static_cast<std::int32_t>(normal.y * 32767.0f);
+
+  const std::uint32_t sign = normal.z >= 0 ? 0 : 1;
+  const std::uint32_t sx = static_cast<std::uint32_t>(x & 0xfffe) | sign;
+  const std::uint32_t sy = static_cast<std::uint32_t>(y & 0xffff) << 16;
+
+  return sx | sy;
+}
+
+void encode_normals(const float* xs, const float* ys, const float* zs, std::uint32_t* out)
+{
+#if defined(__AVX2__)
+  static_assert(NORMAL_BATCH_SIZE == 8);
+  const __m256 scale = _mm256_set1_ps(32767.0f);
+  const __m256i ix = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_load_ps(xs), scale));
+  const __m256i iy = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_load_ps(ys), scale));
+  // NOTE: "not greater or equal" is true for NaNs, just like the `z >= 0 ? 0 : 1` in scalar code
+  const __m256 negative = _mm256_cmp_ps(_mm256_load_ps(zs), _mm256_setzero_ps(), _CMP_NGE_UQ);
+  const __m256i sign = _mm256_srli_epi32(_mm256_castps_si256(negative), 31);
+  const __m256i sx = _mm256_or_si256(_mm256_and_si256(ix, _mm256_set1_epi32(0xfffe)), sign);
+  const __m256i sy = _mm256_slli_epi32(iy, 16);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(out), _mm256_or_si256(sx, sy));
+#elif defined(__SSE2__) || defined(_M_X64)
+  static_assert(NORMAL_BATCH_SIZE % 4 == 0);
+  const __m128 scale = _mm_set1_ps(32767.0f);
+  for (std::size_t i = 0; i < NORMAL_BATCH_SIZE; i += 4)
+  {
+    const __m128i ix = _mm_cvttps_epi32(_mm_mul_ps(_mm_load_ps(xs + i), scale));
+    const __m128i iy = _mm_cvttps_epi32(_mm_mul_ps(_mm_load_ps(ys + i), scale));
+    const __m128 negative = _mm_cmpnge_ps(_mm_load_ps(zs + i), _mm_setzero_ps());
+    const __m128i sign = _mm_srli_epi32(_mm_castps_si128(negative), 31);
+    const __m128i sx = _mm_or_si128(_mm_and_si128(ix, _mm_set1_epi32(0xfffe)), sign);
+    const __m128i sy = _mm_slli_epi32(iy, 16);
+    _mm_store_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(sx, sy));
+  }
+#else
+  for (std::size_t i = 0; i < NORMAL_BATCH_SIZE; ++i)
+    out[i] = encode_normal(glm::vec3(xs[i], ys[i], zs[i]));
+#endif
+}
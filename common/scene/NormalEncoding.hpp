@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+
+// Packs a unit vector into 32 bits: 16-bit snorm x and y, with the lowest bit of x replaced
+// by the sign of z. Zero vectors are encoded as exactly 0.
+std::uint32_t encode_normal(glm::vec3 normal);
+
+constexpr std::size_t NORMAL_BATCH_SIZE = 8;
+
+// Batched version of encode_normal, produces bit-identical results.
+// Lanes are laid out as SoA so that the whole batch fits into a single AVX2 register,
+// so all arrays must hold NORMAL_BATCH_SIZE elements and be aligned to 32 bytes.
+void encode_normals(const float* xs, const float* ys, const float* zs, std::uint32_t* out);
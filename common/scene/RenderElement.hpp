@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "scene/Bounds.hpp"
+
+
+// Including the original, full detail one
+inline constexpr std::size_t MAX_LODS = 4;
+
+// Relems that address few enough vertices keep their indices in a separate 16-bit buffer
+enum class IndexFormat : std::uint32_t
+{
+  U32,
+  U16,
+};
+
+struct IndexRange
+{
+  std::uint32_t offset;
+  std::uint32_t count;
+};
+
+// A single render element (relem) corresponds to a single draw call
+// of a certain pipeline with specific bindings (including material data)
+struct RenderElement
+{
+  std::uint32_t vertexOffset;
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+  // Meshlets covering the indices of this relem, see Meshlet.hpp
+  std::uint32_t firstMeshlet;
+  std::uint32_t meshletCount;
+  // Index ranges of simplified versions of this relem, starting with LOD 1.
+  // They reference the same vertices as the original indices above.
+  std::array<IndexRange, MAX_LODS - 1> lods;
+  // Index buffer that all of the index ranges above point into
+  IndexFormat indexFormat;
+  // In mesh space, coarser LODs reference a subset of the same vertices
+  Bounds bounds;
+  // Not implemented!
+  // Material* material;
+};
+
+// A mesh is a collection of relems. A scene may have the same mesh
+// located in several different places, so a scene consists of **instances**,
+// not meshes.
+struct Mesh
+{
+  std::uint32_t firstRelem;
+  std::uint32_t relemCount;
+  // All relems of a mesh have the same number of LODs, LOD 0 being the original.
+  // Errors are maximal deviations from the original surface in mesh space units.
+  std::uint32_t lodCount;
+  std::array<float, MAX_LODS> lodErrors;
+  // Union of the bounds of all relems
+  Bounds bounds;
+};
+
+inline IndexRange get_lod_indices(const RenderElement& relem, std::size_t lod)
+{
+  return lod == 0 ? IndexRange{.offset = relem.indexOffset, .count = relem.indexCount}
+                  : relem.lods[lod - 1];
+}
+
+inline void set_lod_indices(RenderElement& relem, std::size_t lod, IndexRange range)
+{
+  if (lod == 0)
+  {
+    relem.indexOffset = range.offset;
+    relem.indexCount = range.count;
+  }
+  else
+    relem.lods[lod - 1] = range;
+}
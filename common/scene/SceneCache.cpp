@@ -0,0 +1,302 @@
+#include "SceneCache.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#include "scene/MappedFile.hpp"
+
+
+namespace scene_cache
+{
+
+namespace
+{
+
+constexpr std::uint64_t HASH_MULTIPLIER = 0x9E3779B97F4A7C15ull;
+
+std::uint64_t mix(std::uint64_t value)
+{
+  value ^= value >> 33;
+  value *= 0xFF51AFD7ED558CCDull;
+  value ^= value >> 33;
+  value *= 0xC4CEB9FE1A85EC53ull;
+  value ^= value >> 33;
+  return value;
+}
+
+// NOTE: source buffers can easily be hundreds of megabytes, so the hash processes
+// 4 independent words at a time instead of going byte by byte.
+std::uint64_t hash_bytes(std::span<const std::byte> data, std::uint64_t seed)
+{
+  constexpr std::size_t LANES = 4;
+  constexpr std::size_t BLOCK_SIZE = LANES * sizeof(std::uint64_t);
+
+  std::array<std::uint64_t, LANES> lanes{};
+  for (std::size_t i = 0; i < LANES; ++i)
+    lanes[i] = mix(seed + i);
+
+  auto consume = [&lanes](const std::byte* block) {
+    for (std::size_t i = 0; i < LANES; ++i)
+    {
+      std::uint64_t word;
+      std::memcpy(&word, block + i * sizeof(word), sizeof(word));
+      lanes[i] = (lanes[i] ^ word) * HASH_MULTIPLIER;
+      lanes[i] ^= lanes[i] >> 29;
+    }
+  };
+
+  const std::size_t fullSize = data.size() - data.size() % BLOCK_SIZE;
+  for (std::size_t offset = 0; offset < fullSize; offset += BLOCK_SIZE)
+    consume(data.data() + offset);
+
+  std::array<std::byte, BLOCK_SIZE> tail{};
+  std::memcpy(tail.data(), data.data() + fullSize, data.size() - fullSize);
+  consume(tail.data());
+
+  std::uint64_t result = mix(data.size());
+  for (auto lane : lanes)
+    result = mix(result ^ lane);
+  return result;
+}
+
+template <class T>
+std::optional<std::span<const T>> get_section(
+  std::span<const std::byte> file, const Header& header, Section section)
+{
+  const auto& range = header.sections[static_cast<std::size_t>(section)];
+  if (
+    range.offset % SECTION_ALIGNMENT != 0 || range.size % sizeof(T) != 0 ||
+    range.offset > file.size() || range.size > file.size() - range.offset)
+  {
+    spdlog::error(
+      "Scene cache: section {} is misaligned or out of bounds",
+      static_cast<std::uint32_t>(section));
+    return std::nullopt;
+  }
+
+  return std::span<const T>{
+    reinterpret_cast<const T*>(file.data() + range.offset),
+    static_cast<std::size_t>(range.size / sizeof(T))};
+}
+
+std::vector<std::string> split_lines(std::span<const char> text)
+{
+  std::vector<std::string> result;
+  std::string current;
+  for (char c : text)
+  {
+    if (c != '\n')
+    {
+      current.push_back(c);
+      continue;
+    }
+    result.push_back(std::move(current));
+    current.clear();
+  }
+  return result;
+}
+
+} // namespace
+
+std::filesystem::path get_cache_path(const std::filesystem::path& scene_path)
+{
+  auto result = scene_path;
+  result.replace_extension(".scenecache");
+  return result;
+}
+
+std::optional<std::uint64_t> compute_key(
+  const std::filesystem::path& scene_path,
+  std::span<const std::string> dependencies,
+  std::uint32_t format_version)
+{
+  std::uint64_t key = mix((std::uint64_t{VERSION} << 32) | format_version);
+
+  auto hashFile = [&key](const std::filesystem::path& path) {
+    auto file = MappedFile::open(path);
+    if (!file.has_value())
+      return false;
+    key = hash_bytes(file->data(), key);
+    return true;
+  };
+
+  if (!hashFile(scene_path))
+    return std::nullopt;
+
+  // NOTE: names are hashed as well, so that swapping two dependencies changes the key
+  for (const auto& dependency : dependencies)
+  {
+    key = hash_bytes(std::as_bytes(std::span{dependency}), key);
+    if (!hashFile(scene_path.parent_path() / dependency))
+      return std::nullopt;
+  }
+
+  return key;
+}
+
+std::optional<CacheView> parse(std::span<const std::byte> file, std::uint32_t vertex_stride)
+{
+  if (file.size() < sizeof(Header))
+    return std::nullopt;
+
+  if (reinterpret_cast<std::uintptr_t>(file.data()) % SECTION_ALIGNMENT != 0)
+  {
+    spdlog::error("Scene cache: data is not aligned properly");
+    return std::nullopt;
+  }
+
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (
+    header.magic != MAGIC || header.version != VERSION || header.sectionCount != SECTION_COUNT ||
+    header.vertexStride != vertex_stride)
+    return std::nullopt;
+
+  auto vertices = get_section<std::byte>(file, header, Section::Vertices);
+  auto indices = get_section<std::uint32_t>(file, header, Section::Indices);
+  auto shortIndices = get_section<std::uint16_t>(file, header, Section::ShortIndices);
+  auto relems = get_section<RenderElement>(file, header, Section::RenderElements);
+  auto meshes = get_section<Mesh>(file, header, Section::Meshes);
+  auto meshlets = get_section<Meshlet>(file, header, Section::Meshlets);
+  auto nodeParents = get_section<std::uint32_t>(file, header, Section::NodeParents);
+  auto nodeTranslations = get_section<glm::vec3>(file, header, Section::NodeTranslations);
+  auto nodeRotations = get_section<glm::quat>(file, header, Section::NodeRotations);
+  auto nodeScales = get_section<glm::vec3>(file, header, Section::NodeScales);
+  auto instanceNodes = get_section<std::uint32_t>(file, header, Section::InstanceNodes);
+  auto instanceMeshes = get_section<std::uint32_t>(file, header, Section::InstanceMeshes);
+  auto dependencies = get_section<char>(file, header, Section::Dependencies);
+
+  if (
+    !vertices || !indices || !shortIndices || !relems || !meshes || !meshlets || !nodeParents ||
+    !nodeTranslations || !nodeRotations || !nodeScales || !instanceNodes || !instanceMeshes ||
+    !dependencies || vertices->size() % vertex_stride != 0)
+    return std::nullopt;
+
+  // NOTE: a mismatch here would make TransformHierarchy read out of bounds
+  if (
+    nodeTranslations->size() != nodeParents->size() ||
+    nodeRotations->size() != nodeParents->size() || nodeScales->size() != nodeParents->size() ||
+    instanceNodes->size() != instanceMeshes->size())
+  {
+    spdlog::error("Scene cache: node and instance sections have mismatching sizes");
+    return std::nullopt;
+  }
+
+  // NOTE: the cache is written by us and is keyed by its sources,
+  // so only the layout is validated, not the cross-references.
+  return CacheView{
+    .key = header.key,
+    .dependencies = split_lines(*dependencies),
+    .data =
+      SceneData{
+        .vertices = *vertices,
+        .indices = *indices,
+        .shortIndices = *shortIndices,
+        .relems = *relems,
+        .meshes = *meshes,
+        .meshlets = *meshlets,
+        .nodeParents = *nodeParents,
+        .nodeTranslations = *nodeTranslations,
+        .nodeRotations = *nodeRotations,
+        .nodeScales = *nodeScales,
+        .instanceNodes = *instanceNodes,
+        .instanceMeshes = *instanceMeshes,
+      },
+  };
+}
+
+bool write(
+  const std::filesystem::path& path,
+  std::uint64_t key,
+  std::span<const std::string> dependencies,
+  std::uint32_t vertex_stride,
+  const SceneData& data)
+{
+  std::string dependencyList;
+  for (const auto& dependency : dependencies)
+  {
+    dependencyList += dependency;
+    dependencyList += '\n';
+  }
+
+  const std::array<std::span<const std::byte>, SECTION_COUNT> sections{
+    data.vertices,
+    std::as_bytes(data.indices),
+    std::as_bytes(data.shortIndices),
+    std::as_bytes(data.relems),
+    std::as_bytes(data.meshes),
+    std::as_bytes(data.meshlets),
+    std::as_bytes(data.nodeParents),
+    std::as_bytes(data.nodeTranslations),
+    std::as_bytes(data.nodeRotations),
+    std::as_bytes(data.nodeScales),
+    std::as_bytes(data.instanceNodes),
+    std::as_bytes(data.instanceMeshes),
+    std::as_bytes(std::span{dependencyList}),
+  };
+
+  Header header{
+    .magic = MAGIC,
+    .version = VERSION,
+    .key = key,
+    .vertexStride = vertex_stride,
+    .sectionCount = SECTION_COUNT,
+    .sections = {},
+  };
+
+  std::uint64_t offset = sizeof(Header);
+  for (std::size_t i = 0; i < SECTION_COUNT; ++i)
+  {
+    offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+    header.sections[i] = SectionRange{.offset = offset, .size = sections[i].size()};
+    offset += sections[i].size();
+  }
+
+  auto tmpPath = path;
+  tmpPath += ".tmp";
+
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+      spdlog::warn("Scene cache: unable to create '{}'", tmpPath);
+      return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::uint64_t written = sizeof(Header);
+    const std::array<char, SECTION_ALIGNMENT> padding{};
+    for (std::size_t i = 0; i < SECTION_COUNT; ++i)
+    {
+      out.write(padding.data(), static_cast<std::streamsize>(header.sections[i].offset - written));
+      out.write(
+        reinterpret_cast<const char*>(sections[i].data()),
+        static_cast<std::streamsize>(sections[i].size()));
+      written = header.sections[i].offset + sections[i].size();
+    }
+
+    if (!out)
+    {
+      spdlog::warn("Scene cache: failed to write '{}'", tmpPath);
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tmpPath, path, error);
+  if (error)
+  {
+    spdlog::warn("Scene cache: failed to replace '{}': {}", path, error.message());
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace scene_cache
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "scene/Meshlet.hpp"
+#include "scene/RenderElement.hpp"
+
+
+// On-disc cache of processed glTF scenes, stored next to the source as <name>.scenecache.
+// The cache is keyed by a hash of the source file, the buffer files it references and a
+// version of the data format supplied by the user, so any change to these rebuilds it.
+// Dependencies are recorded in the cache itself, which allows validating it without
+// parsing the source.
+namespace scene_cache
+{
+
+inline constexpr std::uint32_t MAGIC = 0x48434347; // "GCCH"
+inline constexpr std::uint32_t VERSION = 3;
+
+inline constexpr std::size_t SECTION_ALIGNMENT = 16;
+
+enum class Section : std::uint32_t
+{
+  Vertices,
+  Indices,
+  ShortIndices,
+  RenderElements,
+  Meshes,
+  Meshlets,
+  // Node hierarchy in the order expected by TransformHierarchy
+  NodeParents,
+  NodeTranslations,
+  NodeRotations,
+  NodeScales,
+  InstanceNodes,
+  InstanceMeshes,
+  // Paths relative to the source file, separated by newlines
+  Dependencies,
+
+  COUNT,
+};
+
+inline constexpr std::size_t SECTION_COUNT = static_cast<std::size_t>(Section::COUNT);
+
+struct SectionRange
+{
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct Header
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t key;
+  std::uint32_t vertexStride;
+  std::uint32_t sectionCount;
+  std::array<SectionRange, SECTION_COUNT> sections;
+};
+
+// Non-owning views of the cached data, vertices are opaque to the cache
+struct SceneData
+{
+  std::span<const std::byte> vertices;
+  std::span<const std::uint32_t> indices;
+  std::span<const std::uint16_t> shortIndices;
+  std::span<const RenderElement> relems;
+  std::span<const Mesh> meshes;
+  std::span<const Meshlet> meshlets;
+  std::span<const std::uint32_t> nodeParents;
+  std::span<const glm::vec3> nodeTranslations;
+  std::span<const glm::quat> nodeRotations;
+  std::span<const glm::vec3> nodeScales;
+  std::span<const std::uint32_t> instanceNodes;
+  std::span<const std::uint32_t> instanceMeshes;
+};
+
+struct CacheView
+{
+  std::uint64_t key;
+  std::vector<std::string> dependencies;
+  SceneData data;
+};
+
+std::filesystem::path get_cache_path(const std::filesystem::path& scene_path);
+
+// Hashes the source file and its dependencies, fails if any of them can't be read
+std::optional<std::uint64_t> compute_key(
+  const std::filesystem::path& scene_path,
+  std::span<const std::string> dependencies,
+  std::uint32_t format_version);
+
+// Validates the structure of the cache, the key is left for the caller to check
+std::optional<CacheView> parse(std::span<const std::byte> file, std::uint32_t vertex_stride);
+
+// Writes to a temporary file first, so a concurrent reader never sees a partial cache
+bool write(
+  const std::filesystem::path& path,
+  std::uint64_t key,
+  std::span<const std::string> dependencies,
+  std::uint32_t vertex_stride,
+  const SceneData& data);
+
+} // namespace scene_cache
@@ -1,19 +1,132 @@
 #include "SceneManager.hpp"
 
-#include <stack>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
 
 #include <spdlog/spdlog.h>
 #include <fmt/std.h>
-#include <glm/ext/matrix_transform.hpp>
-#include <glm/gtc/quaternion.hpp>
 #include <etna/GlobalContext.hpp>
-#include <etna/OneShotCmdMgr.hpp>
 
+#include "scene/BakedScene.hpp"
+#include "scene/Bounds.hpp"
+#include "scene/GltfInstances.hpp"
+#include "scene/MappedFile.hpp"
+#include "scene/NormalEncoding.hpp"
+#include "scene/SceneCache.hpp"
+#include "scene/ShortIndices.hpp"
+#include "scene/VertexWeld.hpp"
+
+
+namespace
+{
+
+// Amount of scene data uploaded per frame by asynchronous loading
+constexpr std::size_t ASYNC_UPLOAD_BYTES_PER_FRAME = 16 << 20;
+
+// Stable, so that instances of a mesh keep the order of the source
+std::vector<std::uint32_t> sort_by_mesh(std::span<const std::uint32_t> instance_meshes)
+{
+  std::vector<std::uint32_t> order(instance_meshes.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = static_cast<std::uint32_t>(i);
+
+  std::stable_sort(
+    order.begin(), order.end(), [instance_meshes](std::uint32_t a, std::uint32_t b) {
+      return instance_meshes[a] < instance_meshes[b];
+    });
+
+  return order;
+}
+
+template <class T>
+void apply_order(std::vector<T>& values, std::span<const std::uint32_t> order)
+{
+  std::vector<T> result;
+  result.reserve(order.size());
+  for (auto idx : order)
+    result.push_back(values[idx]);
+  values = std::move(result);
+}
+
+InstanceData make_instance_data(const glm::mat4x4& model)
+{
+  return InstanceData{
+    .model = model,
+    .normal = glm::mat4x4(glm::transpose(glm::inverse(glm::mat3x3(model)))),
+  };
+}
+
+// Within every run of instances of a mesh, relem instances go relem by relem
+std::vector<SceneManager::RelemInstance> build_relem_instances(
+  std::span<const std::uint32_t> instance_meshes, std::span<const Mesh> meshes)
+{
+  std::vector<SceneManager::RelemInstance> result;
+
+  std::size_t groupBegin = 0;
+  while (groupBegin < instance_meshes.size())
+  {
+    std::size_t groupEnd = groupBegin + 1;
+    while (
+      groupEnd < instance_meshes.size() && instance_meshes[groupEnd] == instance_meshes[groupBegin])
+      ++groupEnd;
+
+    const auto& mesh = meshes[instance_meshes[groupBegin]];
+    for (std::uint32_t j = 0; j < mesh.relemCount; ++j)
+      for (std::size_t i = groupBegin; i < groupEnd; ++i)
+        result.push_back(SceneManager::RelemInstance{
+          .instance = static_cast<std::uint32_t>(i),
+          .relem = mesh.firstRelem + j,
+        });
+
+    groupBegin = groupEnd;
+  }
+
+  return result;
+}
+
+std::vector<RelemData> make_relem_data(std::span<const RenderElement> relems)
+{
+  std::vector<RelemData> result;
+  result.reserve(relems.size());
+  for (const auto& relem : relems)
+    result.push_back(RelemData{
+      .boxMin = relem.bounds.boxMin,
+      .indexCount = relem.indexCount,
+      .boxMax = relem.bounds.boxMax,
+      .firstIndex = relem.indexOffset,
+      .vertexOffset = relem.vertexOffset,
+      .indexFormat = static_cast<std::uint32_t>(relem.indexFormat),
+      .padding0 = 0,
+      .padding1 = 0,
+    });
+  return result;
+}
+
+} // namespace
 
 SceneManager::SceneManager()
-  : oneShotCommands{etna::get_context().createOneShotCmdMgr()}
-  , transferHelper{etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 4}}
+  : uploader{StreamingUploader::CreateInfo{.chunkSize = 4 << 20, .chunkCount = 16}}
+  , processingPool{std::make_unique<ThreadPool>()}
+{
+}
+
+SceneManager::~SceneManager()
 {
+  cancelPendingScene();
+  // NOTE: retired buffers are destroyed before the uploader, so its copies have to finish first
+  uploader.wait();
+}
+
+void SceneManager::setParallelProcessing(bool enabled)
+{
+  cancelPendingScene();
+
+  if (!enabled)
+    processingPool.reset();
+  else if (processingPool == nullptr)
+    processingPool = std::make_unique<ThreadPool>();
 }
 
 std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path path)
@@ -53,98 +166,236 @@ std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path pat
   return model;
 }
 
-SceneManager::ProcessedInstances SceneManager::processInstances(const tinygltf::Model& model) const
+SceneManager::ProcessedInstances SceneManager::processInstances(
+  const tinygltf::Model& model, std::span<const Mesh> meshes) const
+{
+  auto [hierarchy, instanceNodes, instanceMeshes] = build_hierarchy(model);
+  hierarchy.update(processingPool.get());
+
+  ProcessedInstances result{
+    .hierarchy = std::move(hierarchy),
+    .matrices = {},
+    .data = {},
+    .bounds = {},
+    .bvh = {},
+    .nodes = std::move(instanceNodes),
+    .meshes = std::move(instanceMeshes),
+    .relemInstances = {},
+  };
+  gatherInstances(result, meshes);
+
+  return result;
+}
+
+void SceneManager::gatherInstances(ProcessedInstances& instances, std::span<const Mesh> meshes)
+{
+  const auto order = sort_by_mesh(instances.meshes);
+  apply_order(instances.nodes, order);
+  apply_order(instances.meshes, order);
+
+  const auto worldMatrices = instances.hierarchy.getWorldMatrices();
+
+  instances.matrices.clear();
+  instances.data.clear();
+  instances.bounds.clear();
+  instances.matrices.reserve(instances.nodes.size());
+  instances.data.reserve(instances.nodes.size());
+  instances.bounds.reserve(instances.nodes.size());
+  for (std::size_t i = 0; i < instances.nodes.size(); ++i)
+  {
+    const auto& matrix = worldMatrices[instances.nodes[i]];
+    instances.matrices.push_back(matrix);
+    instances.data.push_back(make_instance_data(matrix));
+    instances.bounds.push_back(transform_bounds(meshes[instances.meshes[i]].bounds, matrix));
+  }
+
+  instances.bvh.build(instances.bounds);
+  instances.relemInstances = build_relem_instances(instances.meshes, meshes);
+}
+
+namespace
+{
+
+// Raw attribute streams of a single glTF primitive
+struct VertexStreams
+{
+  const std::byte* positions;
+  const std::byte* normals;
+  const std::byte* tangents;
+  const std::byte* texcoords;
+
+  std::size_t positionStride;
+  std::size_t normalStride;
+  std::size_t tangentStride;
+  std::size_t texcoordStride;
+};
+
+// Loads `count` (at most a batch) vec3s into SoA arrays
+void gather_vec3_batch(
+  const std::byte* src, std::size_t stride, std::size_t count, float* xs, float* ys, float* zs)
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    float v[3];
+    std::memcpy(v, src + i * stride, sizeof(v));
+    xs[i] = v[0];
+    ys[i] = v[1];
+    zs[i] = v[2];
+  }
+}
+
+// One instantiation per attribute presence and stride combination. When `Packed` is set,
+// all attributes are known to be tightly packed floats, so strides are compile-time constants
+// and the compiler is free to vectorize the copies.
+template <bool HasNormals, bool HasTangents, bool HasTexcoord, bool Packed>
+void decode_vertices(const VertexStreams& streams, std::size_t count, SceneManager::Vertex* dst)
 {
-  std::vector nodeTransforms(model.nodes.size(), glm::identity<glm::mat4x4>());
+  const std::size_t positionStride = Packed ? sizeof(glm::vec3) : streams.positionStride;
+  const std::size_t normalStride = Packed ? sizeof(glm::vec3) : streams.normalStride;
+  const std::size_t tangentStride = Packed ? sizeof(glm::vec4) : streams.tangentStride;
+  const std::size_t texcoordStride = Packed ? sizeof(glm::vec2) : streams.texcoordStride;
 
-  for (std::size_t nodeIdx = 0; nodeIdx < model.nodes.size(); ++nodeIdx)
+  // Fall back to 0 in case we don't have something, encode_normal(0) is exactly 0.
+  // NOTE: if tangents are not available, one could use http://mikktspace.com/
+  // NOTE: if normals are not available, reconstructing them is possible but will look ugly
+  alignas(32) float normals[3][NORMAL_BATCH_SIZE]{};
+  alignas(32) float tangents[3][NORMAL_BATCH_SIZE]{};
+  alignas(32) std::uint32_t encodedNormals[NORMAL_BATCH_SIZE]{};
+  alignas(32) std::uint32_t encodedTangents[NORMAL_BATCH_SIZE]{};
+
+  for (std::size_t first = 0; first < count; first += NORMAL_BATCH_SIZE)
   {
-    const auto& node = model.nodes[nodeIdx];
-    auto& transform = nodeTransforms[nodeIdx];
+    const std::size_t batchSize = std::min(NORMAL_BATCH_SIZE, count - first);
 
-    if (!node.matrix.empty())
+    if constexpr (HasNormals)
     {
-      for (int i = 0; i < 4; ++i)
-        for (int j = 0; j < 4; ++j)
-          transform[i][j] = static_cast<float>(node.matrix[4 * i + j]);
+      gather_vec3_batch(
+        streams.normals + first * normalStride,
+        normalStride,
+        batchSize,
+        normals[0],
+        normals[1],
+        normals[2]);
+      encode_normals(normals[0], normals[1], normals[2], encodedNormals);
     }
-    else
+
+    if constexpr (HasTangents)
     {
-      if (!node.scale.empty())
-        transform = scale(
-          transform,
-          glm::vec3(
-            static_cast<float>(node.scale[0]),
-            static_cast<float>(node.scale[1]),
-            static_cast<float>(node.scale[2])));
-
-      if (!node.rotation.empty())
-        transform *= mat4_cast(glm::quat(
-          static_cast<float>(node.rotation[3]),
-          static_cast<float>(node.rotation[0]),
-          static_cast<float>(node.rotation[1]),
-          static_cast<float>(node.rotation[2])));
-
-      if (!node.translation.empty())
-        transform = translate(
-          transform,
-          glm::vec3(
-            static_cast<float>(node.translation[0]),
-            static_cast<float>(node.translation[1]),
-            static_cast<float>(node.translation[2])));
+      gather_vec3_batch(
+        streams.tangents + first * tangentStride,
+        tangentStride,
+        batchSize,
+        tangents[0],
+        tangents[1],
+        tangents[2]);
+      encode_normals(tangents[0], tangents[1], tangents[2], encodedTangents);
     }
-  }
 
-  std::stack<std::size_t> vertices;
-  for (auto vert : model.scenes[model.defaultScene].nodes)
-    vertices.push(vert);
+    for (std::size_t i = 0; i < batchSize; ++i)
+    {
+      const std::size_t idx = first + i;
 
-  while (!vertices.empty())
-  {
-    auto vert = vertices.top();
-    vertices.pop();
+      glm::vec3 pos;
+      std::memcpy(&pos, streams.positions + idx * positionStride, sizeof(pos));
 
-    for (auto child : model.nodes[vert].children)
-    {
-      nodeTransforms[child] = nodeTransforms[vert] * nodeTransforms[child];
-      vertices.push(child);
+      glm::vec2 texcoord{0};
+      if constexpr (HasTexcoord)
+        std::memcpy(&texcoord, streams.texcoords + idx * texcoordStride, sizeof(texcoord));
+
+      auto& vtx = dst[idx];
+      vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(encodedNormals[i]));
+      vtx.texCoordAndTangentAndPadding =
+        glm::vec4(texcoord, std::bit_cast<float>(encodedTangents[i]), 0);
     }
   }
+}
 
-  ProcessedInstances result;
+using DecodeVerticesFunc = void (*)(const VertexStreams&, std::size_t, SceneManager::Vertex*);
 
-  // Don't overallocate matrices, they are pretty chonky.
-  {
-    std::size_t totalNodesWithMeshes = 0;
-    for (std::size_t i = 0; i < model.nodes.size(); ++i)
-      if (model.nodes[i].mesh >= 0)
-        ++totalNodesWithMeshes;
-    result.matrices.reserve(totalNodesWithMeshes);
-    result.meshes.reserve(totalNodesWithMeshes);
-  }
+template <std::size_t... Is>
+constexpr std::array<DecodeVerticesFunc, sizeof...(Is)> make_decode_table(
+  std::index_sequence<Is...>)
+{
+  return {&decode_vertices<(Is & 1) != 0, (Is & 2) != 0, (Is & 4) != 0, (Is & 8) != 0>...};
+}
 
-  for (std::size_t i = 0; i < model.nodes.size(); ++i)
-    if (model.nodes[i].mesh >= 0)
-    {
-      result.matrices.push_back(nodeTransforms[i]);
-      result.meshes.push_back(model.nodes[i].mesh);
-    }
+constexpr auto DECODE_TABLE = make_decode_table(std::make_index_sequence<16>{});
 
-  return result;
+DecodeVerticesFunc select_decoder(const VertexStreams& streams)
+{
+  const bool hasNormals = streams.normals != nullptr;
+  const bool hasTangents = streams.tangents != nullptr;
+  const bool hasTexcoord = streams.texcoords != nullptr;
+  const bool packed = streams.positionStride == sizeof(glm::vec3) &&
+    (!hasNormals || streams.normalStride == sizeof(glm::vec3)) &&
+    (!hasTangents || streams.tangentStride == sizeof(glm::vec4)) &&
+    (!hasTexcoord || streams.texcoordStride == sizeof(glm::vec2));
+
+  const std::size_t idx = (hasNormals ? 1 : 0) | (hasTangents ? 2 : 0) | (hasTexcoord ? 4 : 0) |
+    (packed ? 8 : 0);
+  return DECODE_TABLE[idx];
 }
 
-static std::uint32_t encode_normal(glm::vec3 normal)
+// Everything needed to decode a single primitive, resolved up front
+struct PrimitiveSource
 {
-  const std::int32_t x = static_cast<std::int32_t>(normal.x * 32767.0f);
-  const std::int32_t y = static_cast<std::int32_t>(normal.y * 32767.0f);
+  VertexStreams vertices;
+  std::size_t vertexCount;
 
-  const std::uint32_t sign = normal.z >= 0 ? 0 : 1;
-  const std::uint32_t sx = static_cast<std::uint32_t>(x & 0xfffe) | sign;
-  const std::uint32_t sy = static_cast<std::uint32_t>(y & 0xffff) << 16;
+  const std::byte* indices;
+  int indexComponentType;
+  std::size_t indexCount;
 
-  return sx | sy;
+  // Placement of the decoded data inside of the unified arrays
+  std::size_t firstVertex;
+  std::size_t firstIndex;
+};
+
+const std::byte* accessor_data(const tinygltf::Model& model, const tinygltf::Accessor& accessor)
+{
+  const auto& bufView = model.bufferViews[accessor.bufferView];
+  return reinterpret_cast<const std::byte*>(model.buffers[bufView.buffer].data.data()) +
+    bufView.byteOffset + accessor.byteOffset;
+}
+
+std::size_t accessor_stride(const tinygltf::Model& model, const tinygltf::Accessor& accessor)
+{
+  const auto& bufView = model.bufferViews[accessor.bufferView];
+  if (bufView.byteStride != 0)
+    return bufView.byteStride;
+
+  return static_cast<std::size_t>(
+    tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+    tinygltf::GetNumComponentsInType(accessor.type));
+}
+
+void decode_indices(
+  const PrimitiveSource& prim, std::size_t first, std::size_t count, std::uint32_t* dst)
+{
+  switch (prim.indexComponentType)
+  {
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    for (std::size_t i = 0; i < count; ++i)
+      dst[i] = static_cast<std::uint8_t>(prim.indices[first + i]);
+    break;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      std::uint16_t index;
+      std::memcpy(&index, prim.indices + (first + i) * sizeof(index), sizeof(index));
+      dst[i] = index;
+    }
+    break;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    std::memcpy(dst, prim.indices + first * sizeof(std::uint32_t), count * sizeof(std::uint32_t));
+    break;
+  default:
+    break;
+  }
 }
 
+} // namespace
+
 SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model& model) const
 {
   // NOTE: glTF assets can have pretty wonky data layouts which are not appropriate
@@ -154,43 +405,30 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
 
   ProcessedMeshes result;
 
-  // Pre-allocate enough memory so as not to hit the
-  // allocator on the memcpy hotpath
-  {
-    std::size_t vertexBytes = 0;
-    std::size_t indexBytes = 0;
-    for (const auto& bufView : model.bufferViews)
-    {
-      switch (bufView.target)
-      {
-      case TINYGLTF_TARGET_ARRAY_BUFFER:
-        vertexBytes += bufView.byteLength;
-        break;
-      case TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER:
-        indexBytes += bufView.byteLength;
-        break;
-      default:
-        break;
-      }
-    }
-    result.vertices.reserve(vertexBytes / sizeof(Vertex));
-    result.indices.reserve(indexBytes / sizeof(std::uint32_t));
-  }
+  std::vector<PrimitiveSource> primitives;
 
   {
     std::size_t totalPrimitives = 0;
     for (const auto& mesh : model.meshes)
       totalPrimitives += mesh.primitives.size();
+    primitives.reserve(totalPrimitives);
     result.relems.reserve(totalPrimitives);
   }
 
   result.meshes.reserve(model.meshes.size());
 
+  // First pass: resolve accessors of all primitives and prefix-sum their sizes into final
+  // offsets. This way the output can be allocated exactly once and decoded in any order.
+  std::size_t totalVertices = 0;
+  std::size_t totalIndices = 0;
   for (const auto& mesh : model.meshes)
   {
     result.meshes.push_back(Mesh{
       .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
       .relemCount = static_cast<std::uint32_t>(mesh.primitives.size()),
+      .lodCount = 1,
+      .lodErrors = {},
+      .bounds = {},
     });
 
     for (const auto& prim : mesh.primitives)
@@ -203,6 +441,14 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
         continue;
       }
 
+      if (prim.indices < 0)
+      {
+        spdlog::warn(
+          "Encountered a non-indexed primitive, these are not supported for now, skipping it!");
+        --result.meshes.back().relemCount;
+        continue;
+      }
+
       const auto normalIt = prim.attributes.find("NORMAL");
       const auto tangentIt = prim.attributes.find("TANGENT");
       const auto texcoordIt = prim.attributes.find("TEXCOORD_0");
@@ -210,190 +456,740 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
       const bool hasNormals = normalIt != prim.attributes.end();
       const bool hasTangents = tangentIt != prim.attributes.end();
       const bool hasTexcoord = texcoordIt != prim.attributes.end();
-      std::array accessorIndices{
-        prim.indices,
-        prim.attributes.at("POSITION"),
-        hasNormals ? normalIt->second : -1,
-        hasTangents ? tangentIt->second : -1,
-        hasTexcoord ? texcoordIt->second : -1,
-      };
-
-      std::array accessors{
-        &model.accessors[prim.indices],
-        &model.accessors[accessorIndices[1]],
-        hasNormals ? &model.accessors[accessorIndices[2]] : nullptr,
-        hasTangents ? &model.accessors[accessorIndices[3]] : nullptr,
-        hasTexcoord ? &model.accessors[accessorIndices[4]] : nullptr,
-      };
-
-      std::array bufViews{
-        &model.bufferViews[accessors[0]->bufferView],
-        &model.bufferViews[accessors[1]->bufferView],
-        hasNormals ? &model.bufferViews[accessors[2]->bufferView] : nullptr,
-        hasTangents ? &model.bufferViews[accessors[3]->bufferView] : nullptr,
-        hasTexcoord ? &model.bufferViews[accessors[4]->bufferView] : nullptr,
-      };
+
+      const auto& indexAccessor = model.accessors[prim.indices];
+      const auto& positionAccessor = model.accessors[prim.attributes.at("POSITION")];
+      const auto* normalAccessor = hasNormals ? &model.accessors[normalIt->second] : nullptr;
+      const auto* tangentAccessor = hasTangents ? &model.accessors[tangentIt->second] : nullptr;
+      const auto* texcoordAccessor =
+        hasTexcoord ? &model.accessors[texcoordIt->second] : nullptr;
+
+      // Indices are guaranteed to have no stride
+      ETNA_VERIFY(model.bufferViews[indexAccessor.bufferView].byteStride == 0);
+
+      const auto& src = primitives.emplace_back(PrimitiveSource{
+        .vertices =
+          VertexStreams{
+            .positions = accessor_data(model, positionAccessor),
+            .normals = hasNormals ? accessor_data(model, *normalAccessor) : nullptr,
+            .tangents = hasTangents ? accessor_data(model, *tangentAccessor) : nullptr,
+            .texcoords = hasTexcoord ? accessor_data(model, *texcoordAccessor) : nullptr,
+            .positionStride = accessor_stride(model, positionAccessor),
+            .normalStride = hasNormals ? accessor_stride(model, *normalAccessor) : 0,
+            .tangentStride = hasTangents ? accessor_stride(model, *tangentAccessor) : 0,
+            .texcoordStride = hasTexcoord ? accessor_stride(model, *texcoordAccessor) : 0,
+          },
+        .vertexCount = positionAccessor.count,
+        .indices = accessor_data(model, indexAccessor),
+        .indexComponentType = indexAccessor.componentType,
+        .indexCount = indexAccessor.count,
+        .firstVertex = totalVertices,
+        .firstIndex = totalIndices,
+      });
 
       result.relems.push_back(RenderElement{
-        .vertexOffset = static_cast<std::uint32_t>(result.vertices.size()),
-        .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
-        .indexCount = static_cast<std::uint32_t>(accessors[0]->count),
+        .vertexOffset = static_cast<std::uint32_t>(src.firstVertex),
+        .indexOffset = static_cast<std::uint32_t>(src.firstIndex),
+        .indexCount = static_cast<std::uint32_t>(src.indexCount),
+        .firstMeshlet = 0,
+        .meshletCount = 0,
+        .lods = {},
+        .indexFormat = IndexFormat::U32,
+        .bounds = {},
       });
 
-      const std::size_t vertexCount = accessors[1]->count;
-
-      std::array ptrs{
-        reinterpret_cast<const std::byte*>(model.buffers[bufViews[0]->buffer].data.data()) +
-          bufViews[0]->byteOffset + accessors[0]->byteOffset,
-        reinterpret_cast<const std::byte*>(model.buffers[bufViews[1]->buffer].data.data()) +
-          bufViews[1]->byteOffset + accessors[1]->byteOffset,
-        hasNormals
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[2]->buffer].data.data()) +
-            bufViews[2]->byteOffset + accessors[2]->byteOffset
-          : nullptr,
-        hasTangents
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[3]->buffer].data.data()) +
-            bufViews[3]->byteOffset + accessors[3]->byteOffset
-          : nullptr,
-        hasTexcoord
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[4]->buffer].data.data()) +
-            bufViews[4]->byteOffset + accessors[4]->byteOffset
-          : nullptr,
-      };
-
-      std::array strides{
-        bufViews[0]->byteStride != 0
-          ? bufViews[0]->byteStride
-          : tinygltf::GetComponentSizeInBytes(accessors[0]->componentType) *
-            tinygltf::GetNumComponentsInType(accessors[0]->type),
-        bufViews[1]->byteStride != 0
-          ? bufViews[1]->byteStride
-          : tinygltf::GetComponentSizeInBytes(accessors[1]->componentType) *
-            tinygltf::GetNumComponentsInType(accessors[1]->type),
-        hasNormals ? (bufViews[2]->byteStride != 0
-                        ? bufViews[2]->byteStride
-                        : tinygltf::GetComponentSizeInBytes(accessors[2]->componentType) *
-                          tinygltf::GetNumComponentsInType(accessors[2]->type))
-                   : 0,
-        hasTangents ? (bufViews[3]->byteStride != 0
-                         ? bufViews[3]->byteStride
-                         : tinygltf::GetComponentSizeInBytes(accessors[3]->componentType) *
-                           tinygltf::GetNumComponentsInType(accessors[3]->type))
-                    : 0,
-        hasTexcoord ? (bufViews[4]->byteStride != 0
-                         ? bufViews[4]->byteStride
-                         : tinygltf::GetComponentSizeInBytes(accessors[4]->componentType) *
-                           tinygltf::GetNumComponentsInType(accessors[4]->type))
-                    : 0,
-      };
-
-      for (std::size_t i = 0; i < vertexCount; ++i)
-      {
-        auto& vtx = result.vertices.emplace_back();
-        glm::vec3 pos;
-        // Fall back to 0 in case we don't have something.
-        // NOTE: if tangents are not available, one could use http://mikktspace.com/
-        // NOTE: if normals are not available, reconstructing them is possible but will look ugly
-        glm::vec3 normal{0};
-        glm::vec3 tangent{0};
-        glm::vec2 texcoord{0};
-        std::memcpy(&pos, ptrs[1], sizeof(pos));
-
-        // NOTE: it's faster to do a template here with specializations for all combinations than to
-        // do ifs at runtime. Also, SIMD should be used. Try implementing this!
-        if (hasNormals)
-          std::memcpy(&normal, ptrs[2], sizeof(normal));
-        if (hasTangents)
-          std::memcpy(&tangent, ptrs[3], sizeof(tangent));
-        if (hasTexcoord)
-          std::memcpy(&texcoord, ptrs[4], sizeof(texcoord));
-
-
-        vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(encode_normal(normal)));
-        vtx.texCoordAndTangentAndPadding =
-          glm::vec4(texcoord, std::bit_cast<float>(encode_normal(tangent)), 0);
-
-        ptrs[1] += strides[1];
-        if (hasNormals)
-          ptrs[2] += strides[2];
-        if (hasTangents)
-          ptrs[3] += strides[3];
-        if (hasTexcoord)
-          ptrs[4] += strides[4];
-      }
+      totalVertices += src.vertexCount;
+      totalIndices += src.indexCount;
+    }
+  }
 
-      // Indices are guaranteed to have no stride
-      ETNA_VERIFY(bufViews[0]->byteStride == 0);
-      const std::size_t indexCount = accessors[0]->count;
-      if (accessors[0]->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
-      {
-        for (std::size_t i = 0; i < indexCount; ++i)
-        {
-          std::uint16_t index;
-          std::memcpy(&index, ptrs[0], sizeof(index));
-          result.indices.push_back(index);
-          ptrs[0] += 2;
-        }
-      }
-      else if (accessors[0]->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
-      {
-        const std::size_t lastTotalIndices = result.indices.size();
-        result.indices.resize(lastTotalIndices + indexCount);
-        std::memcpy(
-          result.indices.data() + lastTotalIndices,
-          ptrs[0],
-          sizeof(result.indices[0]) * indexCount);
-      }
+  result.vertices.resize(totalVertices);
+  result.indices.resize(totalIndices);
+
+  // Second pass: decode. Big primitives are split into chunks, otherwise a single
+  // huge mesh would end up being decoded by a single thread.
+  struct DecodeChunk
+  {
+    std::size_t primitive;
+    std::size_t first;
+    std::size_t count;
+    bool indices;
+  };
+
+  constexpr std::size_t VERTICES_PER_CHUNK = 1 << 15;
+  constexpr std::size_t INDICES_PER_CHUNK = 1 << 17;
+
+  std::vector<DecodeChunk> chunks;
+  for (std::size_t i = 0; i < primitives.size(); ++i)
+  {
+    const auto& prim = primitives[i];
+    for (std::size_t first = 0; first < prim.vertexCount; first += VERTICES_PER_CHUNK)
+      chunks.push_back(DecodeChunk{
+        .primitive = i,
+        .first = first,
+        .count = std::min(VERTICES_PER_CHUNK, prim.vertexCount - first),
+        .indices = false,
+      });
+    for (std::size_t first = 0; first < prim.indexCount; first += INDICES_PER_CHUNK)
+      chunks.push_back(DecodeChunk{
+        .primitive = i,
+        .first = first,
+        .count = std::min(INDICES_PER_CHUNK, prim.indexCount - first),
+        .indices = true,
+      });
+  }
+
+  // NOTE: every chunk writes to its own disjoint range of the output, so no locking is needed
+  auto decodeChunk = [&primitives, &chunks, &result](std::size_t chunk_idx) {
+    const auto& chunk = chunks[chunk_idx];
+    const auto& prim = primitives[chunk.primitive];
+
+    if (chunk.indices)
+    {
+      decode_indices(
+        prim, chunk.first, chunk.count, result.indices.data() + prim.firstIndex + chunk.first);
+      return;
     }
+
+    const VertexStreams streams{
+      .positions = prim.vertices.positions + chunk.first * prim.vertices.positionStride,
+      .normals = prim.vertices.normals != nullptr
+        ? prim.vertices.normals + chunk.first * prim.vertices.normalStride
+        : nullptr,
+      .tangents = prim.vertices.tangents != nullptr
+        ? prim.vertices.tangents + chunk.first * prim.vertices.tangentStride
+        : nullptr,
+      .texcoords = prim.vertices.texcoords != nullptr
+        ? prim.vertices.texcoords + chunk.first * prim.vertices.texcoordStride
+        : nullptr,
+      .positionStride = prim.vertices.positionStride,
+      .normalStride = prim.vertices.normalStride,
+      .tangentStride = prim.vertices.tangentStride,
+      .texcoordStride = prim.vertices.texcoordStride,
+    };
+
+    // NOTE: the decoder is selected once per chunk, so the per-vertex
+    // loop doesn't branch on attribute presence.
+    select_decoder(streams)(
+      streams, chunk.count, result.vertices.data() + prim.firstVertex + chunk.first);
+  };
+
+  if (processingPool != nullptr)
+    processingPool->parallelFor(chunks.size(), decodeChunk);
+  else
+    for (std::size_t i = 0; i < chunks.size(); ++i)
+      decodeChunk(i);
+
+  // Third pass: welding. Relems are welded independently, after which their vertices
+  // are packed tightly and the vertex counts of primitives describe the welded ranges.
+  auto weldRelem = [&primitives, &result](std::size_t relem_idx) {
+    const auto& relem = result.relems[relem_idx];
+    auto& prim = primitives[relem_idx];
+    prim.vertexCount = weld_vertices(
+      std::span{result.indices}.subspan(relem.indexOffset, relem.indexCount),
+      reinterpret_cast<std::byte*>(result.vertices.data() + relem.vertexOffset),
+      sizeof(Vertex),
+      prim.vertexCount);
+  };
+
+  if (processingPool != nullptr)
+    processingPool->parallelFor(result.relems.size(), weldRelem);
+  else
+    for (std::size_t i = 0; i < result.relems.size(); ++i)
+      weldRelem(i);
+
+  // NOTE: relems are laid out in order, so vertices only ever move towards the beginning
+  std::size_t weldedVertices = 0;
+  for (std::size_t i = 0; i < result.relems.size(); ++i)
+  {
+    auto& relem = result.relems[i];
+    std::copy_n(
+      result.vertices.begin() + relem.vertexOffset,
+      primitives[i].vertexCount,
+      result.vertices.begin() + weldedVertices);
+    relem.vertexOffset = static_cast<std::uint32_t>(weldedVertices);
+    weldedVertices += primitives[i].vertexCount;
   }
 
+  spdlog::info(
+    "Welded {} vertices into {}, saved {} bytes",
+    result.vertices.size(),
+    weldedVertices,
+    (result.vertices.size() - weldedVertices) * sizeof(Vertex));
+  result.vertices.resize(weldedVertices);
+
+  // Fourth pass: meshlets and bounds. The count of meshlets is not known upfront, so every
+  // relem gets its own array which are then concatenated.
+  std::vector<std::vector<Meshlet>> relemMeshlets(result.relems.size());
+
+  // NOTE: primitives correspond to relems one-to-one
+  auto buildMeshlets = [&primitives, &result, &relemMeshlets](std::size_t relem_idx) {
+    auto& relem = result.relems[relem_idx];
+    const auto& prim = primitives[relem_idx];
+    const auto indices = std::span{result.indices}.subspan(relem.indexOffset, relem.indexCount);
+    const auto* vertices =
+      reinterpret_cast<const std::byte*>(result.vertices.data() + relem.vertexOffset);
+    relemMeshlets[relem_idx] = build_meshlets(indices, vertices, sizeof(Vertex), prim.vertexCount);
+    relem.bounds = compute_bounds(indices, vertices, sizeof(Vertex));
+  };
+
+  if (processingPool != nullptr)
+    processingPool->parallelFor(result.relems.size(), buildMeshlets);
+  else
+    for (std::size_t i = 0; i < result.relems.size(); ++i)
+      buildMeshlets(i);
+
+  for (std::size_t i = 0; i < result.relems.size(); ++i)
+  {
+    result.relems[i].firstMeshlet = static_cast<std::uint32_t>(result.meshlets.size());
+    result.relems[i].meshletCount = static_cast<std::uint32_t>(relemMeshlets[i].size());
+    result.meshlets.insert(
+      result.meshlets.end(), relemMeshlets[i].begin(), relemMeshlets[i].end());
+  }
+
+  for (auto& mesh : result.meshes)
+  {
+    std::vector<Bounds> relemBounds;
+    relemBounds.reserve(mesh.relemCount);
+    for (const auto& relem : std::span{result.relems}.subspan(mesh.firstRelem, mesh.relemCount))
+      relemBounds.push_back(relem.bounds);
+    mesh.bounds = merge_bounds(relemBounds);
+  }
+
+  // NOTE: meshlet index ranges are relative to their relems, so moving relem indices
+  // around doesn't affect them.
+  result.shortIndices = narrow_indices(result.indices, result.relems);
+
+  result.occluders = build_occluder_geometry(
+    result.meshes,
+    result.relems,
+    result.indices,
+    result.shortIndices,
+    reinterpret_cast<const std::byte*>(result.vertices.data()),
+    sizeof(Vertex));
+
+  return result;
+}
+
+SceneManager::SceneBuffers SceneManager::createBuffers(
+  std::span<const std::byte> vertices,
+  std::span<const std::uint32_t> indices,
+  std::span<const std::uint16_t> short_indices,
+  std::span<const Meshlet> meshlets,
+  std::span<const InstanceData> instances,
+  std::span<const RelemData> relems,
+  std::span<const RelemInstance> relem_instances,
+  std::vector<BufferUpload>& uploads)
+{
+  SceneBuffers result;
+
+  // NOTE: all relems may end up using a single index format, and empty buffers are not allowed
+  auto create = [&result, &uploads](
+                  etna::Buffer SceneBuffers::*buffer,
+                  std::span<const std::byte> data,
+                  vk::BufferUsageFlags usage,
+                  const char* name) {
+    if (data.empty())
+      return;
+
+    result.*buffer = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+      .size = data.size(),
+      .bufferUsage = usage | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = name,
+    });
+    uploads.push_back(BufferUpload{.buffer = buffer, .data = data});
+  };
+
+  create(
+    &SceneBuffers::vertices, vertices, vk::BufferUsageFlagBits::eVertexBuffer, "unifiedVbuf");
+  create(
+    &SceneBuffers::indices,
+    std::as_bytes(indices),
+    vk::BufferUsageFlagBits::eIndexBuffer,
+    "unifiedIbuf");
+  create(
+    &SceneBuffers::shortIndices,
+    std::as_bytes(short_indices),
+    vk::BufferUsageFlagBits::eIndexBuffer,
+    "unifiedShortIbuf");
+  create(
+    &SceneBuffers::meshlets,
+    std::as_bytes(meshlets),
+    vk::BufferUsageFlagBits::eStorageBuffer,
+    "unifiedMeshletBuf");
+  create(
+    &SceneBuffers::instances,
+    std::as_bytes(instances),
+    vk::BufferUsageFlagBits::eStorageBuffer,
+    "unifiedInstanceBuf");
+  create(
+    &SceneBuffers::relems,
+    std::as_bytes(relems),
+    vk::BufferUsageFlagBits::eStorageBuffer,
+    "unifiedRelemBuf");
+  create(
+    &SceneBuffers::relemInstances,
+    std::as_bytes(relem_instances),
+    vk::BufferUsageFlagBits::eStorageBuffer,
+    "unifiedRelemInstanceBuf");
+
   return result;
 }
 
+void SceneManager::IndexBinder::bind(IndexFormat format)
+{
+  if (boundFormat == format)
+    return;
+  cmdBuf.bindIndexBuffer(sceneMgr.getIndexBuffer(format), 0, getIndexType(format));
+  boundFormat = format;
+}
+
+void SceneManager::uploadChunk(
+  SceneBuffers& buffers, const BufferUpload& upload, std::size_t offset, std::size_t size)
+{
+  uploader.uploadBuffer(buffers.*upload.buffer, offset, upload.data.subspan(offset, size));
+}
+
+void SceneManager::setBuffers(SceneBuffers&& buffers)
+{
+  unifiedVbuf = std::move(buffers.vertices);
+  unifiedIbuf = std::move(buffers.indices);
+  unifiedShortIbuf = std::move(buffers.shortIndices);
+  unifiedMeshletBuf = std::move(buffers.meshlets);
+  unifiedInstanceBuf = std::move(buffers.instances);
+  unifiedRelemBuf = std::move(buffers.relems);
+  unifiedRelemInstanceBuf = std::move(buffers.relemInstances);
+}
+
+SceneManager::SceneBuffers SceneManager::takeBuffers()
+{
+  return SceneBuffers{
+    .vertices = std::move(unifiedVbuf),
+    .indices = std::move(unifiedIbuf),
+    .shortIndices = std::move(unifiedShortIbuf),
+    .meshlets = std::move(unifiedMeshletBuf),
+    .instances = std::move(unifiedInstanceBuf),
+    .relems = std::move(unifiedRelemBuf),
+    .relemInstances = std::move(unifiedRelemInstanceBuf),
+  };
+}
+
 void SceneManager::uploadData(
-  std::span<const Vertex> vertices, std::span<const std::uint32_t> indices)
+  std::span<const std::byte> vertices,
+  std::span<const std::uint32_t> indices,
+  std::span<const std::uint16_t> short_indices,
+  std::span<const Meshlet> meshlets,
+  std::span<const InstanceData> instances,
+  std::span<const RelemData> relems,
+  std::span<const RelemInstance> relem_instances)
 {
-  unifiedVbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = vertices.size_bytes(),
-    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
-    .name = "unifiedVbuf",
-  });
+  std::vector<BufferUpload> uploads;
+  auto buffers = createBuffers(
+    vertices, indices, short_indices, meshlets, instances, relems, relem_instances, uploads);
 
-  unifiedIbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = indices.size_bytes(),
-    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
-    .name = "unifiedIbuf",
-  });
+  for (const auto& upload : uploads)
+    uploadChunk(buffers, upload, 0, upload.data.size());
+  uploader.wait();
 
-  transferHelper.uploadBuffer<Vertex>(*oneShotCommands, unifiedVbuf, 0, vertices);
-  transferHelper.uploadBuffer<std::uint32_t>(*oneShotCommands, unifiedIbuf, 0, indices);
+  setBuffers(std::move(buffers));
 }
 
-void SceneManager::selectScene(std::filesystem::path path)
+std::optional<SceneManager::ProcessedScene> SceneManager::processScene(
+  const std::filesystem::path& path)
 {
+  if (auto cached = loadCachedScene(path); cached.has_value())
+    return cached;
+
   auto maybeModel = loadModel(path);
   if (!maybeModel.has_value())
-    return;
+    return std::nullopt;
 
   auto model = std::move(*maybeModel);
 
+  auto processedMeshes = processMeshes(model);
+  auto instances = processInstances(model, processedMeshes.meshes);
+
+  ProcessedScene result{
+    .instances = std::move(instances),
+    .meshes = std::move(processedMeshes),
+  };
+
+  writeCachedScene(path, model, result);
+
+  return result;
+}
+
+std::optional<SceneManager::ProcessedScene> SceneManager::loadCachedScene(
+  const std::filesystem::path& path) const
+{
+  const auto cachePath = scene_cache::get_cache_path(path);
+
+  std::error_code error;
+  if (!std::filesystem::exists(cachePath, error))
+    return std::nullopt;
+
+  auto file = MappedFile::open(cachePath);
+  if (!file.has_value())
+    return std::nullopt;
+
+  auto cache = scene_cache::parse(file->data(), sizeof(Vertex));
+  if (!cache.has_value())
+  {
+    spdlog::info("Scene cache: '{}' has an outdated format, rebuilding it", cachePath);
+    return std::nullopt;
+  }
+
+  const auto key = scene_cache::compute_key(path, cache->dependencies, VERTEX_FORMAT_VERSION);
+  if (!key.has_value() || *key != cache->key)
+  {
+    spdlog::info("Scene cache: '{}' is stale, rebuilding it", cachePath);
+    return std::nullopt;
+  }
+
+  // NOTE: the mapping is closed right after loading, so the data has to be copied out
+  const auto& data = cache->data;
+
+  ProcessedScene result;
+
+  auto& instances = result.instances;
+  instances.hierarchy = TransformHierarchy(
+    {data.nodeParents.begin(), data.nodeParents.end()},
+    {data.nodeTranslations.begin(), data.nodeTranslations.end()},
+    {data.nodeRotations.begin(), data.nodeRotations.end()},
+    {data.nodeScales.begin(), data.nodeScales.end()});
+  instances.hierarchy.update(processingPool.get());
+  instances.nodes.assign(data.instanceNodes.begin(), data.instanceNodes.end());
+  instances.meshes.assign(data.instanceMeshes.begin(), data.instanceMeshes.end());
+  gatherInstances(instances, data.meshes);
+
+  auto& processed = result.meshes;
+  processed.vertices.resize(data.vertices.size() / sizeof(Vertex));
+  std::memcpy(processed.vertices.data(), data.vertices.data(), data.vertices.size());
+  processed.indices.assign(data.indices.begin(), data.indices.end());
+  processed.shortIndices.assign(data.shortIndices.begin(), data.shortIndices.end());
+  processed.relems.assign(data.relems.begin(), data.relems.end());
+  processed.meshes.assign(data.meshes.begin(), data.meshes.end());
+  processed.meshlets.assign(data.meshlets.begin(), data.meshlets.end());
+  processed.occluders = build_occluder_geometry(
+    processed.meshes,
+    processed.relems,
+    processed.indices,
+    processed.shortIndices,
+    reinterpret_cast<const std::byte*>(processed.vertices.data()),
+    sizeof(Vertex));
+
+  spdlog::info("Scene cache: loaded '{}' from '{}'", path, cachePath);
+
+  return result;
+}
+
+void SceneManager::writeCachedScene(
+  const std::filesystem::path& path,
+  const tinygltf::Model& model,
+  const ProcessedScene& scene) const
+{
+  // Embedded buffers are covered by the hash of the scene file itself
+  std::vector<std::string> dependencies;
+  for (const auto& buffer : model.buffers)
+    if (!buffer.uri.empty() && !buffer.uri.starts_with("data:"))
+      dependencies.push_back(buffer.uri);
+
+  const auto key = scene_cache::compute_key(path, dependencies, VERTEX_FORMAT_VERSION);
+  if (!key.has_value())
+  {
+    spdlog::warn("Scene cache: unable to hash the sources of '{}', not caching it", path);
+    return;
+  }
+
+  const auto& processed = scene.meshes;
+  scene_cache::write(
+    scene_cache::get_cache_path(path),
+    *key,
+    dependencies,
+    sizeof(Vertex),
+    scene_cache::SceneData{
+      .vertices = std::as_bytes(std::span{processed.vertices}),
+      .indices = processed.indices,
+      .shortIndices = processed.shortIndices,
+      .relems = processed.relems,
+      .meshes = processed.meshes,
+      .meshlets = processed.meshlets,
+      .nodeParents = scene.instances.hierarchy.getParents(),
+      .nodeTranslations = scene.instances.hierarchy.getTranslations(),
+      .nodeRotations = scene.instances.hierarchy.getRotations(),
+      .nodeScales = scene.instances.hierarchy.getScales(),
+      .instanceNodes = scene.instances.nodes,
+      .instanceMeshes = scene.instances.meshes,
+    });
+}
+
+void SceneManager::applyProcessedScene(ProcessedScene&& scene)
+{
   // By aggregating all SceneManager fields mutations here,
   // we guarantee that we don't forget to clear something
   // when re-loading a scene.
 
-  // NOTE: you might want to store these on the GPU for GPU-driven rendering.
-  auto [instMats, instMeshes] = processInstances(model);
-  instanceMatrices = std::move(instMats);
-  instanceMeshes = std::move(instMeshes);
+  // NOTE: instance data is already on the GPU by now, the CPU copy is
+  // kept for updating it when the hierarchy changes.
+  instanceMatrices = std::move(scene.instances.matrices);
+  instanceData = std::move(scene.instances.data);
+  instanceBounds = std::move(scene.instances.bounds);
+  instanceBvh = std::move(scene.instances.bvh);
+  instanceMeshes = std::move(scene.instances.meshes);
+  transformHierarchy = std::move(scene.instances.hierarchy);
+  instanceNodes = std::move(scene.instances.nodes);
+  relemInstances = std::move(scene.instances.relemInstances);
 
-  auto [verts, inds, relems, meshs] = processMeshes(model);
+  renderElements = std::move(scene.meshes.relems);
+  meshes = std::move(scene.meshes.meshes);
+  meshlets = std::move(scene.meshes.meshlets);
+  occluders = std::move(scene.meshes.occluders);
 
-  renderElements = std::move(relems);
-  meshes = std::move(meshs);
+  updateRelemInstanceBoxes();
+  ++sceneVersion;
+}
+
+void SceneManager::selectScene(std::filesystem::path path)
+{
+  cancelPendingScene();
+
+  auto scene = processScene(path);
+  if (!scene.has_value())
+    return;
+
+  uploadData(
+    std::as_bytes(std::span{scene->meshes.vertices}),
+    scene->meshes.indices,
+    scene->meshes.shortIndices,
+    scene->meshes.meshlets,
+    scene->instances.data,
+    make_relem_data(scene->meshes.relems),
+    scene->instances.relemInstances);
+
+  applyProcessedScene(std::move(*scene));
+}
+
+std::shared_future<bool> SceneManager::selectSceneAsync(std::filesystem::path path)
+{
+  cancelPendingScene();
+
+  pendingScene = std::make_unique<PendingScene>();
+  pendingScene->processing = std::async(
+    std::launch::async, [this, path = std::move(path)]() { return processScene(path); });
 
-  uploadData(verts, inds);
+  return pendingScene->loaded.get_future().share();
+}
+
+void SceneManager::update()
+{
+  std::erase_if(retiredBuffers, [](RetiredBuffers& retired) { return retired.framesLeft-- == 0; });
+
+  updateTransforms();
+
+  if (pendingScene == nullptr)
+    return;
+
+  auto& pending = *pendingScene;
+
+  if (!pending.scene.has_value())
+  {
+    if (pending.processing.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+      return;
+
+    pending.scene = pending.processing.get();
+    if (!pending.scene.has_value())
+    {
+      pending.loaded.set_value(false);
+      pendingScene.reset();
+      return;
+    }
+
+    const auto& processed = pending.scene->meshes;
+    pending.relemData = make_relem_data(processed.relems);
+    pending.buffers = createBuffers(
+      std::as_bytes(std::span{processed.vertices}),
+      processed.indices,
+      processed.shortIndices,
+      processed.meshlets,
+      pending.scene->instances.data,
+      pending.relemData,
+      pending.scene->instances.relemInstances,
+      pending.uploads);
+  }
+
+  // NOTE: the uploader only blocks when the GPU lags behind, which is avoided by never
+  // uploading more than fits into the free part of the ring. The budget bounds the time
+  // spent copying to the ring.
+  std::size_t budget = std::min<std::size_t>(ASYNC_UPLOAD_BYTES_PER_FRAME, uploader.freeSpace());
+  while (budget > 0 && pending.currentUpload < pending.uploads.size())
+  {
+    const auto& upload = pending.uploads[pending.currentUpload];
+    const std::size_t size = std::min(budget, upload.data.size() - pending.currentUploadOffset);
+
+    uploadChunk(pending.buffers, upload, pending.currentUploadOffset, size);
+
+    budget -= size;
+    pending.currentUploadOffset += size;
+    if (pending.currentUploadOffset == upload.data.size())
+    {
+      ++pending.currentUpload;
+      pending.currentUploadOffset = 0;
+    }
+  }
+
+  if (pending.currentUpload < pending.uploads.size())
+    return;
+
+  // The new scene is swapped in only once the GPU has finished copying all of it
+  uploader.flush();
+  if (!uploader.poll())
+    return;
+
+  retiredBuffers.push_back(RetiredBuffers{
+    .buffers = takeBuffers(),
+    .framesLeft = etna::get_context().getMainWorkCount().multiBufferingCount() + 1,
+  });
+  setBuffers(std::move(pending.buffers));
+  applyProcessedScene(std::move(*pending.scene));
+
+  pending.loaded.set_value(true);
+  pendingScene.reset();
+}
+
+void SceneManager::cancelPendingScene()
+{
+  if (pendingScene == nullptr)
+    return;
+
+  // NOTE: the worker uses the loader and the thread pool, so it has to be finished first
+  if (pendingScene->processing.valid())
+    pendingScene->processing.wait();
+
+  // Copies into the pending buffers may still be recorded or executing, so the buffers
+  // are retired just like replaced ones instead of being destroyed right away.
+  uploader.flush();
+  retiredBuffers.push_back(RetiredBuffers{
+    .buffers = std::move(pendingScene->buffers),
+    .framesLeft = etna::get_context().getMainWorkCount().multiBufferingCount() + 1,
+  });
+
+  pendingScene->loaded.set_value(false);
+  pendingScene.reset();
+}
+
+void SceneManager::updateTransforms()
+{
+  transformHierarchy.update(processingPool.get());
+  if (!transformHierarchy.hasChanges())
+    return;
+
+  const auto worldMatrices = transformHierarchy.getWorldMatrices();
+
+  // NOTE: edits usually touch a few subtrees, so only runs of changed instances are uploaded
+  std::size_t runBegin = 0;
+  for (std::size_t i = 0; i <= instanceNodes.size(); ++i)
+  {
+    if (i < instanceNodes.size() && transformHierarchy.wasChanged(instanceNodes[i]))
+    {
+      instanceMatrices[i] = worldMatrices[instanceNodes[i]];
+      instanceData[i] = make_instance_data(instanceMatrices[i]);
+      instanceBounds[i] = transform_bounds(meshes[instanceMeshes[i]].bounds, instanceMatrices[i]);
+      continue;
+    }
+
+    if (runBegin < i)
+      uploader.uploadBuffer(
+        unifiedInstanceBuf,
+        runBegin * sizeof(InstanceData),
+        std::span<const InstanceData>{instanceData}.subspan(runBegin, i - runBegin));
+    runBegin = i + 1;
+  }
+  uploader.flush();
+
+  instanceBvh.refit(instanceBounds);
+
+  for (std::size_t i = 0; i < relemInstances.size(); ++i)
+  {
+    const auto [instance, relem] = relemInstances[i];
+    if (transformHierarchy.wasChanged(instanceNodes[instance]))
+      relemInstanceBoxes.set(
+        i, transform_bounds(renderElements[relem].bounds, instanceMatrices[instance]));
+  }
+}
+
+void SceneManager::updateRelemInstanceBoxes()
+{
+  relemInstanceBoxes.resize(relemInstances.size());
+  for (std::size_t i = 0; i < relemInstances.size(); ++i)
+  {
+    const auto [instance, relem] = relemInstances[i];
+    relemInstanceBoxes.set(
+      i, transform_bounds(renderElements[relem].bounds, instanceMatrices[instance]));
+  }
+}
+
+void SceneManager::selectBakedScene(std::filesystem::path path)
+{
+  cancelPendingScene();
+
+  // NOTE: the json part only exists for debugging with third-party viewers,
+  // everything we need is described by the header of the binary part.
+  auto binPath = path;
+  binPath.replace_extension(".bin");
+
+  auto file = MappedFile::open(binPath);
+  if (!file.has_value())
+    return;
+
+  auto scene = baked::parse(file->data());
+  if (!scene.has_value())
+  {
+    spdlog::error("Baked scene: failed to load '{}'", binPath);
+    return;
+  }
+
+  instanceMatrices.assign(scene->instanceMatrices.begin(), scene->instanceMatrices.end());
+  instanceMeshes.assign(scene->instanceMeshes.begin(), scene->instanceMeshes.end());
+
+  const auto order = sort_by_mesh(instanceMeshes);
+  apply_order(instanceMatrices, order);
+  apply_order(instanceMeshes, order);
+
+  renderElements.assign(scene->relems.begin(), scene->relems.end());
+  meshes.assign(scene->meshes.begin(), scene->meshes.end());
+  meshlets.assign(scene->meshlets.begin(), scene->meshlets.end());
+  occluders = build_occluder_geometry(
+    meshes,
+    renderElements,
+    scene->indices,
+    scene->shortIndices,
+    reinterpret_cast<const std::byte*>(scene->vertices.data()),
+    sizeof(baked::Vertex));
+
+  instanceData.clear();
+  instanceBounds.clear();
+  for (std::size_t i = 0; i < instanceMatrices.size(); ++i)
+  {
+    instanceData.push_back(make_instance_data(instanceMatrices[i]));
+    instanceBounds.push_back(
+      transform_bounds(meshes[instanceMeshes[i]].bounds, instanceMatrices[i]));
+  }
+  instanceBvh.build(instanceBounds);
+  transformHierarchy = TransformHierarchy();
+  instanceNodes.clear();
+  relemInstances = build_relem_instances(instanceMeshes, meshes);
+  updateRelemInstanceBoxes();
+
+  uploadData(
+    std::as_bytes(scene->vertices),
+    scene->indices,
+    scene->shortIndices,
+    meshlets,
+    instanceData,
+    make_relem_data(renderElements),
+    relemInstances);
+  ++sceneVersion;
 }
 
 etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription()
@@ -411,3 +1207,27 @@ etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription
       },
     }};
 }
+
+etna::VertexByteStreamFormatDescription SceneManager::getBakedVertexFormatDescription()
+{
+  return etna::VertexByteStreamFormatDescription{
+    .stride = sizeof(baked::Vertex),
+    .attributes = {
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR32G32B32Sfloat,
+        .offset = offsetof(baked::Vertex, position),
+      },
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR8G8B8A8Snorm,
+        .offset = offsetof(baked::Vertex, normal),
+      },
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR32G32Sfloat,
+        .offset = offsetof(baked::Vertex, texCoord),
+      },
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR8G8B8A8Snorm,
+        .offset = offsetof(baked::Vertex, tangent),
+      },
+    }};
+}
@@ -1,45 +1,88 @@
 #pragma once
 
 #include <filesystem>
+#include <future>
+#include <memory>
+#include <optional>
 
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
 #include <etna/Buffer.hpp>
-#include <etna/BlockingTransferHelper.hpp>
 #include <etna/VertexInput.hpp>
 
+#include "parallel/ThreadPool.hpp"
+#include "render_utils/StreamingUploader.hpp"
+#include "InstanceData.h"
+#include "RelemData.h"
+#include "scene/Bvh.hpp"
+#include "scene/FrustumCulling.hpp"
+#include "scene/Meshlet.hpp"
+#include "scene/RenderElement.hpp"
+#include "scene/SoftwareOcclusion.hpp"
+#include "scene/TransformHierarchy.hpp"
 
-// A single render element (relem) corresponds to a single draw call
-// of a certain pipeline with specific bindings (including material data)
-struct RenderElement
-{
-  std::uint32_t vertexOffset;
-  std::uint32_t indexOffset;
-  std::uint32_t indexCount;
-  // Not implemented!
-  // Material* material;
-};
-
-// A mesh is a collection of relems. A scene may have the same mesh
-// located in several different places, so a scene consists of **instances**,
-// not meshes.
-struct Mesh
-{
-  std::uint32_t firstRelem;
-  std::uint32_t relemCount;
-};
 
 class SceneManager
 {
 public:
   SceneManager();
+  ~SceneManager();
 
   void selectScene(std::filesystem::path path);
 
-  // Every instance is a mesh drawn with a certain transform
+  // Starts loading a scene in the background: parsing and processing happen on a worker
+  // thread, after which update() uploads the data in bounded chunks over several frames.
+  // The current scene keeps being rendered until the new one is entirely on the GPU, then
+  // all of the data is swapped at once. The future becomes ready after the swap, holding false
+  // if the scene failed to load. Selecting another scene in the meantime cancels this one.
+  std::shared_future<bool> selectSceneAsync(std::filesystem::path path);
+
+  // Advances background loading and propagates modified node transforms to instances,
+  // must be called once per frame from the render thread
+  void update();
+  bool isLoading() const { return pendingScene != nullptr; }
+  // Changes every time another scene is swapped in, even if it looks the same as the last one
+  std::uint64_t getSceneVersion() const { return sceneVersion; }
+
+  // Loads a scene produced by model_bakery_baker, the vertex and index data
+  // goes to the GPU straight from a memory-mapped file.
+  void selectBakedScene(std::filesystem::path path);
+
+  // Decode glTF data on all available cores (enabled by default)
+  void setParallelProcessing(bool enabled);
+
+  // Every instance is a mesh drawn with a certain transform.
+  // Instances are sorted by mesh, so that a mesh can be drawn for all of them with a single
+  // instanced call, and the instance buffer matches this order.
   // NOTE: maybe you can pass some additional data through unused matrix entries?
   std::span<const glm::mat4x4> getInstanceMatrices() { return instanceMatrices; }
   std::span<const std::uint32_t> getInstanceMeshes() { return instanceMeshes; }
+  // World space bounds of every instance, kept in sync with the matrices
+  std::span<const Bounds> getInstanceBounds() { return instanceBounds; }
+  // Hierarchy over instance bounds for culling and spatial queries, items are instances.
+  // Rebuilt when a scene is loaded and refitted when transforms change.
+  const Bvh& getInstanceBvh() { return instanceBvh; }
+
+  // Local transforms of nodes can be modified at any time, instance matrices catch up on
+  // the next update(). Baked scenes are flattened, so their hierarchy is empty.
+  TransformHierarchy& getTransformHierarchy() { return transformHierarchy; }
+  // Hierarchy node of every instance, empty for baked scenes
+  std::span<const std::uint32_t> getInstanceNodes() { return instanceNodes; }
+
+  // A relem drawn for a certain instance, the unit of culling.
+  // Within every run of instances of a mesh, relem instances are grouped by relem and then
+  // ordered by instance, so visible relem instances that follow each other in this order and
+  // share a relem are consecutive instances, which can still be drawn with a single call.
+  struct RelemInstance
+  {
+    std::uint32_t instance;
+    std::uint32_t relem;
+  };
+  // NOTE: the GPU copy is read as an array of uvec2
+  static_assert(sizeof(RelemInstance) == sizeof(glm::uvec2));
+  std::span<const RelemInstance> getRelemInstances() { return relemInstances; }
+  // World space boxes of relem instances in the same order, kept in sync with the matrices
+  const CullingBoxes& getRelemInstanceBoxes() { return relemInstanceBoxes; }
 
   // Every mesh is a collection of relems
   std::span<const Mesh> getMeshes() { return meshes; }
@@ -47,21 +90,52 @@ public:
   // Every relem is a single draw call
   std::span<const RenderElement> getRenderElements() { return renderElements; }
 
-  vk::Buffer getVertexBuffer() { return unifiedVbuf.get(); }
-  vk::Buffer getIndexBuffer() { return unifiedIbuf.get(); }
+  // Every relem is split into meshlets for fine-grained culling
+  std::span<const Meshlet> getMeshlets() { return meshlets; }
 
-  etna::VertexByteStreamFormatDescription getVertexFormatDescription();
+  // Coarse geometry of every mesh for software occlusion culling, see OcclusionBuffer
+  const OccluderGeometry& getOccluders() { return occluders; }
 
-private:
-  std::optional<tinygltf::Model> loadModel(std::filesystem::path path);
+  vk::Buffer getVertexBuffer() { return unifiedVbuf.get(); }
+  // Relems only use the buffer matching their indexFormat, either of these may be null
+  vk::Buffer getIndexBuffer(IndexFormat format)
+  {
+    return format == IndexFormat::U16 ? unifiedShortIbuf.get() : unifiedIbuf.get();
+  }
+  static vk::IndexType getIndexType(IndexFormat format)
+  {
+    return format == IndexFormat::U16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+  }
 
-  struct ProcessedInstances
+  // Binds the index buffer matching the format of every drawn relem while recording draws.
+  // NOTE: consecutive relems mostly use the same index format,
+  // so the index buffer only gets rebound when it actually changes.
+  class IndexBinder
   {
-    std::vector<glm::mat4x4> matrices;
-    std::vector<std::uint32_t> meshes;
+  public:
+    IndexBinder(SceneManager& scene_mgr, vk::CommandBuffer cmd_buf)
+      : sceneMgr{scene_mgr}
+      , cmdBuf{cmd_buf}
+    {
+    }
+
+    void bind(IndexFormat format);
+
+  private:
+    SceneManager& sceneMgr;
+    vk::CommandBuffer cmdBuf;
+    std::optional<IndexFormat> boundFormat;
   };
+  vk::Buffer getMeshletBuffer() { return unifiedMeshletBuf.get(); }
+  // Matrices of every instance, kept in sync with getInstanceMatrices() by update().
+  // Returned as etna::Buffer for binding it to descriptor sets, null if there are no instances.
+  const etna::Buffer& getInstanceBuffer() { return unifiedInstanceBuf; }
+  // RelemData of every relem and a uvec2 of every relem instance, for culling on the GPU
+  const etna::Buffer& getRelemBuffer() { return unifiedRelemBuf; }
+  const etna::Buffer& getRelemInstanceBuffer() { return unifiedRelemInstanceBuf; }
 
-  ProcessedInstances processInstances(const tinygltf::Model& model) const;
+  etna::VertexByteStreamFormatDescription getVertexFormatDescription();
+  etna::VertexByteStreamFormatDescription getBakedVertexFormatDescription();
 
   struct Vertex
   {
@@ -73,26 +147,158 @@ private:
 
   static_assert(sizeof(Vertex) == sizeof(float) * 8);
 
+  // Part of the scene cache key, bump it whenever Vertex or the way
+  // meshes are processed changes, so that stale caches get rebuilt.
+  static constexpr std::uint32_t VERTEX_FORMAT_VERSION = 1;
+
+private:
+  std::optional<tinygltf::Model> loadModel(std::filesystem::path path);
+
+  struct ProcessedInstances
+  {
+    TransformHierarchy hierarchy;
+    std::vector<glm::mat4x4> matrices;
+    std::vector<InstanceData> data;
+    std::vector<Bounds> bounds;
+    Bvh bvh;
+    std::vector<std::uint32_t> nodes;
+    std::vector<std::uint32_t> meshes;
+    std::vector<RelemInstance> relemInstances;
+  };
+
+  // Sorts instances by mesh and fills matrices, data, bounds, the bvh and relem instances
+  // from an up to date hierarchy
+  static void gatherInstances(ProcessedInstances& instances, std::span<const Mesh> meshes);
+
+  // Meshes have to be processed first, as bounds of instances are derived from theirs
+  ProcessedInstances processInstances(
+    const tinygltf::Model& model, std::span<const Mesh> meshes) const;
+
   struct ProcessedMeshes
   {
     std::vector<Vertex> vertices;
     std::vector<std::uint32_t> indices;
+    std::vector<std::uint16_t> shortIndices;
     std::vector<RenderElement> relems;
     std::vector<Mesh> meshes;
+    std::vector<Meshlet> meshlets;
+    // Not cached, as it is cheap to extract from the rest
+    OccluderGeometry occluders;
   };
   ProcessedMeshes processMeshes(const tinygltf::Model& model) const;
-  void uploadData(std::span<const Vertex> vertices, std::span<const std::uint32_t>);
+
+  struct ProcessedScene
+  {
+    ProcessedInstances instances;
+    ProcessedMeshes meshes;
+  };
+  // Doesn't touch the GPU or the current scene, so it is safe to call from a worker thread
+  std::optional<ProcessedScene> processScene(const std::filesystem::path& path);
+  std::optional<ProcessedScene> loadCachedScene(const std::filesystem::path& path) const;
+  void writeCachedScene(
+    const std::filesystem::path& path,
+    const tinygltf::Model& model,
+    const ProcessedScene& scene) const;
+  // Takes the CPU side of the scene, vertex and index data has to be uploaded beforehand
+  void applyProcessedScene(ProcessedScene&& scene);
+
+  // Buffers are left null when there is no data for them
+  struct SceneBuffers
+  {
+    etna::Buffer vertices;
+    etna::Buffer indices;
+    etna::Buffer shortIndices;
+    etna::Buffer meshlets;
+    etna::Buffer instances;
+    etna::Buffer relems;
+    etna::Buffer relemInstances;
+  };
+
+  // Data that has to be copied into one of the scene buffers
+  struct BufferUpload
+  {
+    etna::Buffer SceneBuffers::*buffer;
+    std::span<const std::byte> data;
+  };
+
+  SceneBuffers createBuffers(
+    std::span<const std::byte> vertices,
+    std::span<const std::uint32_t> indices,
+    std::span<const std::uint16_t> short_indices,
+    std::span<const Meshlet> meshlets,
+    std::span<const InstanceData> instances,
+    std::span<const RelemData> relems,
+    std::span<const RelemInstance> relem_instances,
+    std::vector<BufferUpload>& uploads);
+  void uploadChunk(
+    SceneBuffers& buffers, const BufferUpload& upload, std::size_t offset, std::size_t size);
+  void setBuffers(SceneBuffers&& buffers);
+  SceneBuffers takeBuffers();
+
+  void uploadData(
+    std::span<const std::byte> vertices,
+    std::span<const std::uint32_t> indices,
+    std::span<const std::uint16_t> short_indices,
+    std::span<const Meshlet> meshlets,
+    std::span<const InstanceData> instances,
+    std::span<const RelemData> relems,
+    std::span<const RelemInstance> relem_instances);
+
+  void cancelPendingScene();
+
+  void updateTransforms();
+  // Recomputes world boxes of all relem instances
+  void updateRelemInstanceBoxes();
 
 private:
   tinygltf::TinyGLTF loader;
-  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
-  etna::BlockingTransferHelper transferHelper;
+  StreamingUploader uploader;
+  std::unique_ptr<ThreadPool> processingPool;
 
   std::vector<RenderElement> renderElements;
   std::vector<Mesh> meshes;
+  std::vector<Meshlet> meshlets;
+  OccluderGeometry occluders;
   std::vector<glm::mat4x4> instanceMatrices;
+  std::vector<InstanceData> instanceData;
+  std::vector<Bounds> instanceBounds;
+  Bvh instanceBvh;
   std::vector<std::uint32_t> instanceMeshes;
+  std::vector<RelemInstance> relemInstances;
+  CullingBoxes relemInstanceBoxes;
+
+  TransformHierarchy transformHierarchy;
+  std::vector<std::uint32_t> instanceNodes;
 
   etna::Buffer unifiedVbuf;
   etna::Buffer unifiedIbuf;
+  etna::Buffer unifiedShortIbuf;
+  etna::Buffer unifiedMeshletBuf;
+  etna::Buffer unifiedInstanceBuf;
+  etna::Buffer unifiedRelemBuf;
+  etna::Buffer unifiedRelemInstanceBuf;
+
+  struct PendingScene
+  {
+    std::future<std::optional<ProcessedScene>> processing;
+    // Set once processing is done, uploads point into it
+    std::optional<ProcessedScene> scene;
+    std::vector<RelemData> relemData;
+    SceneBuffers buffers;
+    std::vector<BufferUpload> uploads;
+    std::size_t currentUpload = 0;
+    std::size_t currentUploadOffset = 0;
+    std::promise<bool> loaded;
+  };
+  std::unique_ptr<PendingScene> pendingScene;
+
+  // Buffers replaced by an asynchronous load may still be used by frames in flight
+  struct RetiredBuffers
+  {
+    SceneBuffers buffers;
+    std::size_t framesLeft;
+  };
+  std::vector<RetiredBuffers> retiredBuffers;
+
+  std::uint64_t sceneVersion = 0;
 };
@@ -0,0 +1,69 @@
+#include "ShortIndices.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <utility>
+
+
+std::vector<std::uint16_t> narrow_indices(
+  std::vector<std::uint32_t>& indices, std::span<RenderElement> relems)
+{
+  std::vector<std::uint32_t> wideIndices;
+  std::vector<std::uint16_t> shortIndices;
+  wideIndices.reserve(indices.size());
+  shortIndices.reserve(indices.size());
+
+  for (auto& relem : relems)
+  {
+    // LOD ranges that were not generated repeat the coarsest one, these are moved only once
+    std::array<IndexRange, MAX_LODS> oldRanges;
+    std::array<IndexRange, MAX_LODS> newRanges;
+    for (std::size_t i = 0; i < MAX_LODS; ++i)
+      oldRanges[i] = get_lod_indices(relem, i);
+
+    std::uint32_t maxIndex = 0;
+    for (const auto& range : oldRanges)
+      for (auto index : std::span{indices}.subspan(range.offset, range.count))
+        maxIndex = std::max(maxIndex, index);
+
+    const bool narrow = maxIndex <= std::numeric_limits<std::uint16_t>::max();
+    relem.indexFormat = narrow ? IndexFormat::U16 : IndexFormat::U32;
+
+    for (std::size_t i = 0; i < MAX_LODS; ++i)
+    {
+      const auto& oldRange = oldRanges[i];
+      auto& newRange = newRanges[i];
+      newRange.count = oldRange.count;
+
+      const auto duplicate = std::find_if(
+        oldRanges.begin(), oldRanges.begin() + i, [&oldRange](const IndexRange& other) {
+          return other.offset == oldRange.offset && other.count == oldRange.count;
+        });
+      if (duplicate != oldRanges.begin() + i)
+      {
+        newRange = newRanges[static_cast<std::size_t>(duplicate - oldRanges.begin())];
+        continue;
+      }
+
+      const auto src = std::span{indices}.subspan(oldRange.offset, oldRange.count);
+      if (narrow)
+      {
+        newRange.offset = static_cast<std::uint32_t>(shortIndices.size());
+        for (auto index : src)
+          shortIndices.push_back(static_cast<std::uint16_t>(index));
+      }
+      else
+      {
+        newRange.offset = static_cast<std::uint32_t>(wideIndices.size());
+        wideIndices.insert(wideIndices.end(), src.begin(), src.end());
+      }
+    }
+
+    for (std::size_t i = 0; i < MAX_LODS; ++i)
+      set_lod_indices(relem, i, newRanges[i]);
+  }
+
+  indices = std::move(wideIndices);
+  return shortIndices;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "scene/RenderElement.hpp"
+
+
+// Moves every index range (LODs included) of relems whose indices all fit into 16 bits
+// into a separate array and switches these relems to IndexFormat::U16. The remaining
+// 32-bit indices are packed tightly. Index ranges of relems must not overlap,
+// except for LOD ranges of a single relem being shared.
+std::vector<std::uint16_t> narrow_indices(
+  std::vector<std::uint32_t>& indices, std::span<RenderElement> relems);
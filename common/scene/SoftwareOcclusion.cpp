@@ -0,0 +1,389 @@
+#include "SoftwareOcclusion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+
+namespace
+{
+
+constexpr std::uint32_t WIDTH = OcclusionBuffer::WIDTH;
+constexpr std::uint32_t HEIGHT = OcclusionBuffer::HEIGHT;
+constexpr std::uint32_t TILE_SIZE = OcclusionBuffer::TILE_SIZE;
+constexpr std::uint32_t TILES_X = WIDTH / TILE_SIZE;
+constexpr std::uint32_t TILES_Y = HEIGHT / TILE_SIZE;
+
+static_assert(WIDTH % TILE_SIZE == 0 && HEIGHT % TILE_SIZE == 0);
+
+// Pixels processed at once, rows are filled from a multiple of this, which never
+// goes past the end of a row as the width is a multiple of it as well
+#if defined(__AVX2__)
+constexpr std::int32_t LANES = 8;
+#elif defined(__SSE2__) || defined(_M_X64)
+constexpr std::int32_t LANES = 4;
+#else
+constexpr std::int32_t LANES = 1;
+#endif
+
+static_assert(WIDTH % LANES == 0);
+
+// Pixels in [begin, end) of the row that are covered by the triangle get the nearest of
+// their depth and that of the triangle. Coverage is tested at pixel centers.
+template <class Triangle>
+void rasterize_row(float* row, std::int32_t begin, std::int32_t end, float y, const Triangle& tri)
+{
+  // Parts of the planes that don't change along the row
+  std::array<float, 3> rowEdges;
+  for (std::size_t i = 0; i < 3; ++i)
+    rowEdges[i] = tri.edges[i].y * y + tri.edges[i].z;
+  const float rowDepth = tri.depth.y * y + tri.depth.z;
+
+#if defined(__AVX2__)
+  const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+  const __m256 zero = _mm256_setzero_ps();
+
+  for (std::int32_t x = begin; x < end; x += LANES)
+  {
+    const __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), offsets);
+
+    __m256 covered = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+      const __m256 edge = _mm256_add_ps(
+        _mm256_set1_ps(rowEdges[i]), _mm256_mul_ps(_mm256_set1_ps(tri.edges[i].x), px));
+      covered = _mm256_and_ps(covered, _mm256_cmp_ps(edge, zero, _CMP_GE_OQ));
+    }
+
+    const __m256 depth =
+      _mm256_add_ps(_mm256_set1_ps(rowDepth), _mm256_mul_ps(_mm256_set1_ps(tri.depth.x), px));
+    const __m256 old = _mm256_loadu_ps(row + x);
+    _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, _mm256_min_ps(old, depth), covered));
+  }
+#elif defined(__SSE2__) || defined(_M_X64)
+  const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+
+  for (std::int32_t x = begin; x < end; x += LANES)
+  {
+    const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+
+    __m128 covered = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+      const __m128 edge =
+        _mm_add_ps(_mm_set1_ps(rowEdges[i]), _mm_mul_ps(_mm_set1_ps(tri.edges[i].x), px));
+      covered = _mm_and_ps(covered, _mm_cmpge_ps(edge, zero));
+    }
+
+    const __m128 depth =
+      _mm_add_ps(_mm_set1_ps(rowDepth), _mm_mul_ps(_mm_set1_ps(tri.depth.x), px));
+    const __m128 old = _mm_loadu_ps(row + x);
+    // NOTE: blendv is SSE4.1, so the mask selects by hand
+    const __m128 nearest = _mm_min_ps(old, depth);
+    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(covered, nearest), _mm_andnot_ps(covered, old)));
+  }
+#else
+  for (std::int32_t x = begin; x < end; ++x)
+  {
+    const float px = static_cast<float>(x) + 0.5f;
+
+    bool covered = true;
+    for (std::size_t i = 0; i < 3; ++i)
+      covered = covered && rowEdges[i] + tri.edges[i].x * px >= 0.0f;
+
+    if (covered)
+      row[x] = std::min(row[x], rowDepth + tri.depth.x * px);
+  }
+#endif
+}
+
+} // namespace
+
+OccluderGeometry build_occluder_geometry(
+  std::span<const Mesh> meshes,
+  std::span<const RenderElement> relems,
+  std::span<const std::uint32_t> indices,
+  std::span<const std::uint16_t> short_indices,
+  const std::byte* vertices,
+  std::size_t vertex_stride)
+{
+  OccluderGeometry result;
+  result.meshes.reserve(meshes.size());
+
+  // Relems only reference a part of the vertex buffer, the occluder gets a compact copy of it
+  std::unordered_map<std::uint32_t, std::uint32_t> remap;
+
+  for (const auto& mesh : meshes)
+  {
+    OccluderGeometry::Mesh occluder{
+      .vertexOffset = static_cast<std::uint32_t>(result.vertices.size()),
+      .vertexCount = 0,
+      .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
+      .indexCount = 0,
+    };
+
+    const auto meshRelems = relems.subspan(mesh.firstRelem, mesh.relemCount);
+    const std::size_t lod = std::max(mesh.lodCount, 1u) - 1;
+
+    std::size_t triangleCount = 0;
+    for (const auto& relem : meshRelems)
+      triangleCount += get_lod_indices(relem, lod).count / 3;
+
+    if (triangleCount > MAX_OCCLUDER_MESH_TRIANGLES)
+    {
+      result.meshes.push_back(occluder);
+      continue;
+    }
+
+    for (const auto& relem : meshRelems)
+    {
+      const auto range = get_lod_indices(relem, lod);
+
+      remap.clear();
+      for (std::uint32_t i = 0; i < range.count; ++i)
+      {
+        const std::uint32_t index = relem.indexFormat == IndexFormat::U16
+          ? short_indices[range.offset + i]
+          : indices[range.offset + i];
+
+        const auto [it, inserted] = remap.try_emplace(
+          index, static_cast<std::uint32_t>(result.vertices.size()) - occluder.vertexOffset);
+        if (inserted)
+        {
+          glm::vec3 position;
+          std::memcpy(
+            &position,
+            vertices + (relem.vertexOffset + index) * vertex_stride,
+            sizeof(position));
+          result.vertices.push_back(position);
+        }
+        result.indices.push_back(it->second);
+      }
+    }
+
+    occluder.vertexCount =
+      static_cast<std::uint32_t>(result.vertices.size()) - occluder.vertexOffset;
+    occluder.indexCount =
+      static_cast<std::uint32_t>(result.indices.size()) - occluder.indexOffset;
+    result.meshes.push_back(occluder);
+  }
+
+  return result;
+}
+
+OcclusionBuffer::OcclusionBuffer()
+  : viewProj{1.0f}
+  , depth(WIDTH * HEIGHT, 1.0f)
+  , tileDepth(TILES_X * TILES_Y, 1.0f)
+{
+}
+
+void OcclusionBuffer::clear(const glm::mat4x4& view_proj)
+{
+  viewProj = view_proj;
+  triangles.clear();
+  std::fill(depth.begin(), depth.end(), 1.0f);
+  std::fill(tileDepth.begin(), tileDepth.end(), 1.0f);
+}
+
+void OcclusionBuffer::addOccluder(
+  std::span<const glm::vec3> vertices,
+  std::span<const std::uint32_t> indices,
+  const glm::mat4x4& model)
+{
+  const glm::mat4x4 transform = viewProj * model;
+
+  clipVertices.clear();
+  for (const auto& vertex : vertices)
+    clipVertices.push_back(transform * glm::vec4(vertex, 1.0f));
+
+  for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+    addTriangle(
+      clipVertices[indices[i]], clipVertices[indices[i + 1]], clipVertices[indices[i + 2]]);
+}
+
+void OcclusionBuffer::addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+  // NOTE: the near plane is at z = 0 in Vulkan clip space, clipping a triangle
+  // against a single plane leaves at most a quad
+  const std::array<glm::vec4, 3> input{a, b, c};
+  std::array<glm::vec4, 4> polygon;
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    const auto& current = input[i];
+    const auto& next = input[(i + 1) % 3];
+    if (current.z >= 0.0f)
+      polygon[count++] = current;
+    if ((current.z >= 0.0f) != (next.z >= 0.0f))
+      polygon[count++] = current + (next - current) * (current.z / (current.z - next.z));
+  }
+  if (count < 3)
+    return;
+
+  std::array<glm::vec3, 4> screen;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const auto& clip = polygon[i];
+    if (clip.w <= 0.0f)
+      return;
+    screen[i] = {
+      (clip.x / clip.w * 0.5f + 0.5f) * static_cast<float>(WIDTH),
+      (clip.y / clip.w * 0.5f + 0.5f) * static_cast<float>(HEIGHT),
+      clip.z / clip.w,
+    };
+  }
+
+  for (std::size_t i = 1; i + 1 < count; ++i)
+    setupTriangle(screen[0], screen[i], screen[i + 1]);
+}
+
+void OcclusionBuffer::setupTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+  // Occluders are not necessarily closed, so both sides of triangles hide things
+  float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+  if (area < 0.0f)
+  {
+    std::swap(b, c);
+    area = -area;
+  }
+  // NOTE: also rejects NaNs coming from degenerate clipping
+  if (!(area > 1e-6f))
+    return;
+
+  // Pixels whose centers are inside of the bounding box, clamped to the screen before
+  // converting, as coordinates of vertices close to the near plane may be huge
+  auto firstPixel = [](float min, std::uint32_t size) {
+    return static_cast<std::int32_t>(
+      std::ceil(std::clamp(min - 0.5f, 0.0f, static_cast<float>(size))));
+  };
+  auto lastPixel = [](float max, std::uint32_t size) {
+    return static_cast<std::int32_t>(
+      std::floor(std::clamp(max - 0.5f, -1.0f, static_cast<float>(size - 1))));
+  };
+
+  Triangle tri{
+    .edges = {},
+    .depth = {},
+    .minX = firstPixel(std::min({a.x, b.x, c.x}), WIDTH),
+    .maxX = lastPixel(std::max({a.x, b.x, c.x}), WIDTH),
+    .minY = firstPixel(std::min({a.y, b.y, c.y}), HEIGHT),
+    .maxY = lastPixel(std::max({a.y, b.y, c.y}), HEIGHT),
+  };
+  if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+    return;
+
+  // Edge opposite to every vertex, positive inside of the triangle and equal to
+  // the doubled area at that vertex, so they double as barycentric coordinates
+  const std::array<std::pair<glm::vec3, glm::vec3>, 3> edgeVertices{{{b, c}, {c, a}, {a, b}}};
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    const auto& [from, to] = edgeVertices[i];
+    const float dx = from.y - to.y;
+    const float dy = to.x - from.x;
+    tri.edges[i] = {dx, dy, -(dx * from.x + dy * from.y)};
+  }
+  tri.depth = (tri.edges[0] * a.z + tri.edges[1] * b.z + tri.edges[2] * c.z) / area;
+
+  triangles.push_back(tri);
+}
+
+void OcclusionBuffer::rasterize(ThreadPool* pool)
+{
+  // NOTE: bands don't share pixels, so threads never write to the same memory
+  if (pool != nullptr)
+    pool->parallelFor(TILES_Y, [this](std::size_t band) {
+      rasterizeBand(static_cast<std::uint32_t>(band));
+    });
+  else
+    for (std::uint32_t band = 0; band < TILES_Y; ++band)
+      rasterizeBand(band);
+}
+
+void OcclusionBuffer::rasterizeBand(std::uint32_t band)
+{
+  const auto bandBegin = static_cast<std::int32_t>(band * TILE_SIZE);
+  const auto bandEnd = static_cast<std::int32_t>(bandBegin + TILE_SIZE);
+
+  for (const auto& tri : triangles)
+  {
+    if (tri.maxY < bandBegin || tri.minY >= bandEnd)
+      continue;
+
+    const std::int32_t begin = tri.minX / LANES * LANES;
+    const std::int32_t rowBegin = std::max(tri.minY, bandBegin);
+    const std::int32_t rowEnd = std::min(tri.maxY + 1, bandEnd);
+    for (std::int32_t y = rowBegin; y < rowEnd; ++y)
+      rasterize_row(
+        depth.data() + y * WIDTH, begin, tri.maxX + 1, static_cast<float>(y) + 0.5f, tri);
+  }
+
+  for (std::uint32_t tileX = 0; tileX < TILES_X; ++tileX)
+  {
+    float farthest = 0.0f;
+    for (std::uint32_t y = 0; y < TILE_SIZE; ++y)
+    {
+      const float* row = depth.data() + (band * TILE_SIZE + y) * WIDTH + tileX * TILE_SIZE;
+      farthest = std::max(farthest, *std::max_element(row, row + TILE_SIZE));
+    }
+    tileDepth[band * TILES_X + tileX] = farthest;
+  }
+}
+
+bool OcclusionBuffer::isVisible(const glm::vec3& box_min, const glm::vec3& box_max) const
+{
+  glm::vec2 rectMin{std::numeric_limits<float>::max()};
+  glm::vec2 rectMax{std::numeric_limits<float>::lowest()};
+  float nearest = 1.0f;
+  for (std::uint32_t i = 0; i < 8; ++i)
+  {
+    const glm::vec3 corner{
+      (i & 1) != 0 ? box_max.x : box_min.x,
+      (i & 2) != 0 ? box_max.y : box_min.y,
+      (i & 4) != 0 ? box_max.z : box_min.z,
+    };
+    const glm::vec4 clip = viewProj * glm::vec4(corner, 1.0f);
+    if (clip.z < 0.0f || clip.w <= 0.0f)
+      return true;
+
+    const glm::vec2 pixel{
+      (clip.x / clip.w * 0.5f + 0.5f) * static_cast<float>(WIDTH),
+      (clip.y / clip.w * 0.5f + 0.5f) * static_cast<float>(HEIGHT),
+    };
+    rectMin = glm::min(rectMin, pixel);
+    rectMax = glm::max(rectMax, pixel);
+    nearest = std::min(nearest, clip.z / clip.w);
+  }
+
+  // Pixels touched by the rectangle, the part of it outside of the screen can't be seen anyway
+  auto pixel = [](float coord, std::uint32_t size) {
+    return static_cast<std::uint32_t>(
+      std::clamp(std::floor(coord), 0.0f, static_cast<float>(size - 1)));
+  };
+  const std::uint32_t x0 = pixel(rectMin.x, WIDTH);
+  const std::uint32_t x1 = pixel(rectMax.x, WIDTH);
+  const std::uint32_t y0 = pixel(rectMin.y, HEIGHT);
+  const std::uint32_t y1 = pixel(rectMax.y, HEIGHT);
+
+  float farthest = 0.0f;
+  for (std::uint32_t tileY = y0 / TILE_SIZE; tileY <= y1 / TILE_SIZE; ++tileY)
+    for (std::uint32_t tileX = x0 / TILE_SIZE; tileX <= x1 / TILE_SIZE; ++tileX)
+      farthest = std::max(farthest, tileDepth[tileY * TILES_X + tileX]);
+  if (nearest > farthest)
+    return false;
+
+  // Tiles only cover the rectangle partially, so individual pixels may still hide the box
+  for (std::uint32_t y = y0; y <= y1; ++y)
+    for (std::uint32_t x = x0; x <= x1; ++x)
+      if (depth[y * WIDTH + x] >= nearest)
+        return true;
+
+  return false;
+}
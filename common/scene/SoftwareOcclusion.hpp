@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "parallel/ThreadPool.hpp"
+#include "scene/RenderElement.hpp"
+
+
+// Coarse copies of mesh geometry that the CPU rasterizes to find what hides behind it.
+// Occluders don't need to match the meshes exactly, so they are built from the coarsest LOD.
+struct OccluderGeometry
+{
+  // Mesh space positions, indices of every mesh start from 0 at its vertexOffset
+  std::vector<glm::vec3> vertices;
+  std::vector<std::uint32_t> indices;
+
+  struct Mesh
+  {
+    std::uint32_t vertexOffset;
+    std::uint32_t vertexCount;
+    std::uint32_t indexOffset;
+    std::uint32_t indexCount;
+  };
+  // One per scene mesh, meshes too detailed to be rasterized cheaply get no indices
+  std::vector<Mesh> meshes;
+};
+
+// Meshes with more triangles than this in their coarsest LOD are not used as occluders
+inline constexpr std::size_t MAX_OCCLUDER_MESH_TRIANGLES = 2048;
+
+// Positions are 3 floats located at the beginning of every vertex
+OccluderGeometry build_occluder_geometry(
+  std::span<const Mesh> meshes,
+  std::span<const RenderElement> relems,
+  std::span<const std::uint32_t> indices,
+  std::span<const std::uint16_t> short_indices,
+  const std::byte* vertices,
+  std::size_t vertex_stride);
+
+/**
+ * Low resolution depth buffer that occluders are rasterized into on the CPU, for configurations
+ * where culling on the GPU costs as much as it saves. Rows are filled several pixels at a time
+ * with SIMD coverage masks, bands of tiles are rasterized by different threads. On top of the
+ * pixels, every tile keeps its farthest depth, so that most boxes are tested against a few tiles.
+ * Depth is in [0, 1] with 1 being far, as produced by Vulkan projections.
+ */
+class OcclusionBuffer
+{
+public:
+  static constexpr std::uint32_t WIDTH = 256;
+  static constexpr std::uint32_t HEIGHT = 128;
+  static constexpr std::uint32_t TILE_SIZE = 8;
+
+  OcclusionBuffer();
+
+  // Forgets all occluders and starts a new frame seen through the matrix
+  void clear(const glm::mat4x4& view_proj);
+
+  // Triangles are transformed and clipped right away, so the data doesn't have to outlive the call
+  void addOccluder(
+    std::span<const glm::vec3> vertices,
+    std::span<const std::uint32_t> indices,
+    const glm::mat4x4& model);
+  std::size_t getTriangleCount() const { return triangles.size(); }
+
+  // Has to be called after all occluders are added and before testing anything
+  void rasterize(ThreadPool* pool = nullptr);
+
+  // False if the box is entirely behind rasterized occluders.
+  // NOTE: boxes crossing the near plane or the borders of the screen are tested conservatively.
+  bool isVisible(const glm::vec3& box_min, const glm::vec3& box_max) const;
+
+private:
+  // Edge functions and depth are planes over pixel coordinates: a * x + b * y + c
+  struct Triangle
+  {
+    std::array<glm::vec3, 3> edges;
+    glm::vec3 depth;
+    std::int32_t minX, maxX, minY, maxY;
+  };
+
+  // Clips a triangle in clip space against the near plane
+  void addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+  // Takes pixel coordinates and depth of an unclipped triangle of any winding
+  void setupTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c);
+  void rasterizeBand(std::uint32_t band);
+
+private:
+  glm::mat4x4 viewProj;
+  std::vector<Triangle> triangles;
+  std::vector<glm::vec4> clipVertices;
+
+  std::vector<float> depth;
+  std::vector<float> tileDepth;
+};
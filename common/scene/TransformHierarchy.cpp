@@ -0,0 +1,135 @@
+#include "TransformHierarchy.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include <glm/ext/matrix_transform.hpp>
+
+
+namespace
+{
+
+// Levels smaller than this are not worth waking up the worker threads for
+constexpr std::size_t PARALLEL_LEVEL_SIZE = 4096;
+constexpr std::size_t PARALLEL_CHUNK_SIZE = 1024;
+
+// T * R * S, the order mandated by glTF
+glm::mat4x4 compose_local(
+  const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+  glm::mat4x4 result = mat4_cast(rotation);
+  result[0] *= scale.x;
+  result[1] *= scale.y;
+  result[2] *= scale.z;
+  result[3] = glm::vec4(translation, 1.0f);
+  return result;
+}
+
+} // namespace
+
+TransformHierarchy::TransformHierarchy(
+  std::vector<std::uint32_t> node_parents,
+  std::vector<glm::vec3> local_translations,
+  std::vector<glm::quat> local_rotations,
+  std::vector<glm::vec3> local_scales)
+  : parents{std::move(node_parents)}
+  , translations{std::move(local_translations)}
+  , rotations{std::move(local_rotations)}
+  , scales{std::move(local_scales)}
+  , worldMatrices(parents.size(), glm::identity<glm::mat4x4>())
+  , dirty(parents.size(), 1)
+  , changed(parents.size(), 0)
+  , firstDirty{0}
+{
+  std::vector<std::uint32_t> depths(parents.size(), 0);
+  for (std::size_t i = 0; i < parents.size(); ++i)
+  {
+    if (parents[i] != NO_PARENT)
+      depths[i] = depths[parents[i]] + 1;
+
+    if (i == 0 || depths[i] != depths[i - 1])
+      levelOffsets.push_back(i);
+  }
+  levelOffsets.push_back(parents.size());
+}
+
+void TransformHierarchy::setTranslation(std::uint32_t node, const glm::vec3& translation)
+{
+  translations[node] = translation;
+  markDirty(node);
+}
+
+void TransformHierarchy::setRotation(std::uint32_t node, const glm::quat& rotation)
+{
+  rotations[node] = rotation;
+  markDirty(node);
+}
+
+void TransformHierarchy::setScale(std::uint32_t node, const glm::vec3& scale)
+{
+  scales[node] = scale;
+  markDirty(node);
+}
+
+void TransformHierarchy::markDirty(std::uint32_t node)
+{
+  dirty[node] = 1;
+  firstDirty = std::min<std::size_t>(firstDirty, node);
+}
+
+void TransformHierarchy::update(ThreadPool* pool)
+{
+  const bool hasDirty = firstDirty < size();
+
+  // The pass starts at the level of the first dirty node, as nothing above it can change
+  auto firstLevel = levelOffsets.end();
+  std::size_t passBegin = size();
+  if (hasDirty)
+  {
+    firstLevel = std::upper_bound(levelOffsets.begin(), levelOffsets.end(), firstDirty) - 1;
+    passBegin = *firstLevel;
+  }
+
+  // Flags from the previous update that won't be overwritten by the pass
+  if (anyChanged)
+    std::fill(changed.begin(), changed.begin() + passBegin, std::uint8_t{0});
+
+  anyChanged = hasDirty;
+  if (!hasDirty)
+    return;
+
+  // NOTE: nodes of a level only read the results of previous levels, so a level can be split
+  // between threads arbitrarily, but levels themselves have to go one after another.
+  for (auto level = firstLevel; level + 1 != levelOffsets.end(); ++level)
+  {
+    const std::size_t begin = *level;
+    const std::size_t count = *(level + 1) - begin;
+
+    if (pool != nullptr && count >= PARALLEL_LEVEL_SIZE)
+      pool->parallelForChunks(
+        count, PARALLEL_CHUNK_SIZE, [this, begin](std::size_t from, std::size_t to) {
+          updateRange(begin + from, begin + to);
+        });
+    else
+      updateRange(begin, begin + count);
+  }
+
+  firstDirty = size();
+}
+
+void TransformHierarchy::updateRange(std::size_t begin, std::size_t end)
+{
+  for (std::size_t i = begin; i < end; ++i)
+  {
+    const auto parent = parents[i];
+    const bool parentChanged = parent != NO_PARENT && changed[parent] != 0;
+
+    changed[i] = static_cast<std::uint8_t>(dirty[i] != 0 || parentChanged);
+    if (changed[i] == 0)
+      continue;
+
+    const auto local = compose_local(translations[i], rotations[i], scales[i]);
+    worldMatrices[i] = parent != NO_PARENT ? worldMatrices[parent] * local : local;
+    dirty[i] = 0;
+  }
+}
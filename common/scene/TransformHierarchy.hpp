@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "parallel/ThreadPool.hpp"
+
+
+/**
+ * Node hierarchy stored as a structure of arrays. Nodes are sorted by depth, so parents
+ * always precede their children and every level of the tree is a contiguous range.
+ * This turns propagation of world transforms into a single linear pass, and nodes of
+ * a level are independent from each other, so big levels can be processed in parallel.
+ *
+ * Modifying a local transform only marks the node as dirty, world matrices of dirty
+ * nodes and all of their descendants get recomputed by the next update().
+ */
+class TransformHierarchy
+{
+public:
+  static constexpr std::uint32_t NO_PARENT = std::numeric_limits<std::uint32_t>::max();
+
+  TransformHierarchy() = default;
+
+  // Parents must have smaller depths than their children, and nodes must be sorted by depth
+  TransformHierarchy(
+    std::vector<std::uint32_t> node_parents,
+    std::vector<glm::vec3> local_translations,
+    std::vector<glm::quat> local_rotations,
+    std::vector<glm::vec3> local_scales);
+
+  std::size_t size() const { return parents.size(); }
+
+  std::span<const std::uint32_t> getParents() const { return parents; }
+  std::span<const glm::vec3> getTranslations() const { return translations; }
+  std::span<const glm::quat> getRotations() const { return rotations; }
+  std::span<const glm::vec3> getScales() const { return scales; }
+
+  // Up to date as of the last update()
+  std::span<const glm::mat4x4> getWorldMatrices() const { return worldMatrices; }
+
+  // Whether the world matrix of a node was recomputed by the last update()
+  bool wasChanged(std::uint32_t node) const { return changed[node] != 0; }
+  bool hasChanges() const { return anyChanged; }
+
+  void setTranslation(std::uint32_t node, const glm::vec3& translation);
+  void setRotation(std::uint32_t node, const glm::quat& rotation);
+  void setScale(std::uint32_t node, const glm::vec3& scale);
+
+  // Recomputes world matrices of dirty nodes and their descendants
+  void update(ThreadPool* pool = nullptr);
+
+private:
+  void markDirty(std::uint32_t node);
+  void updateRange(std::size_t begin, std::size_t end);
+
+private:
+  std::vector<std::uint32_t> parents;
+  std::vector<glm::vec3> translations;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+  std::vector<glm::mat4x4> worldMatrices;
+
+  // NOTE: bytes instead of vector<bool>, so that different nodes can be written concurrently
+  std::vector<std::uint8_t> dirty;
+  std::vector<std::uint8_t> changed;
+  bool anyChanged = false;
+
+  // Start of every level of the tree, followed by the total amount of nodes
+  std::vector<std::size_t> levelOffsets;
+  std::size_t firstDirty = 0;
+};
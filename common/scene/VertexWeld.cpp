@@ -0,0 +1,84 @@
+#include "VertexWeld.hpp"
+
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+
+namespace
+{
+
+constexpr std::uint32_t EMPTY_SLOT = std::numeric_limits<std::uint32_t>::max();
+
+// NOTE: vertices are always made of 4-byte words, so hashing them word by word
+// with murmur-style mixing is both fast and good enough for exact matching.
+std::uint32_t hash_vertex(const std::byte* vertex, std::size_t vertex_stride)
+{
+  constexpr std::uint32_t M = 0x5bd1e995;
+
+  std::uint32_t hash = 0;
+  for (std::size_t offset = 0; offset + sizeof(std::uint32_t) <= vertex_stride;
+       offset += sizeof(std::uint32_t))
+  {
+    std::uint32_t word;
+    std::memcpy(&word, vertex + offset, sizeof(word));
+
+    word *= M;
+    word ^= word >> 24;
+    word *= M;
+    hash = hash * M ^ word;
+  }
+
+  hash ^= hash >> 13;
+  hash *= M;
+  hash ^= hash >> 15;
+  return hash;
+}
+
+} // namespace
+
+std::size_t weld_vertices(
+  std::span<std::uint32_t> indices,
+  std::byte* vertices,
+  std::size_t vertex_stride,
+  std::size_t vertex_count)
+{
+  // Open addressing with linear probing, kept at most half full
+  const std::size_t tableSize = std::bit_ceil(vertex_count * 2 + 1);
+  const std::size_t tableMask = tableSize - 1;
+  std::vector<std::uint32_t> table(tableSize, EMPTY_SLOT);
+
+  std::vector<std::uint32_t> remap(vertex_count);
+  std::uint32_t uniqueCount = 0;
+
+  for (std::size_t i = 0; i < vertex_count; ++i)
+  {
+    const std::byte* vertex = vertices + i * vertex_stride;
+
+    std::size_t slot = hash_vertex(vertex, vertex_stride) & tableMask;
+    while (
+      table[slot] != EMPTY_SLOT &&
+      std::memcmp(vertices + table[slot] * vertex_stride, vertex, vertex_stride) != 0)
+      slot = (slot + 1) & tableMask;
+
+    if (table[slot] != EMPTY_SLOT)
+    {
+      remap[i] = table[slot];
+      continue;
+    }
+
+    // Unique vertices are packed in place. The destination is never past the current
+    // vertex, so vertices that are yet to be visited stay intact.
+    if (uniqueCount != i)
+      std::memcpy(vertices + uniqueCount * vertex_stride, vertex, vertex_stride);
+
+    table[slot] = uniqueCount;
+    remap[i] = uniqueCount++;
+  }
+
+  for (auto& index : indices)
+    index = remap[index];
+
+  return uniqueCount;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+
+// Merges vertices of a single relem that are identical bit for bit, which is
+// what glTF exporters produce when splitting vertices per face. Surviving vertices
+// are packed to the beginning of the array in their original order and indices are
+// rewritten to refer to them. The whole vertex is compared, so any padding must be
+// zeroed. Returns the amount of surviving vertices.
+std::size_t weld_vertices(
+  std::span<std::uint32_t> indices,
+  std::byte* vertices,
+  std::size_t vertex_stride,
+  std::size_t vertex_count);
@@ -0,0 +1,17 @@
+#ifndef INSTANCE_DATA_H_INCLUDED
+#define INSTANCE_DATA_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Element of SceneManager's instance buffer, indexed by gl_InstanceIndex
+struct InstanceData
+{
+  shader_mat4 model;
+  // Inverse transpose of the model matrix, only the upper 3x3 part is meaningful.
+  // NOTE: stored as a full matrix, as mat3 columns are padded to vec4 in std430 anyway.
+  shader_mat4 normal;
+};
+
+
+#endif // INSTANCE_DATA_H_INCLUDED
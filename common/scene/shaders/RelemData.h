@@ -0,0 +1,23 @@
+#ifndef RELEM_DATA_H_INCLUDED
+#define RELEM_DATA_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Element of SceneManager's relem buffer, everything needed to cull and draw a relem on the GPU
+struct RelemData
+{
+  // Object space box, w components are occupied by draw parameters to keep std430 happy
+  shader_vec3 boxMin;
+  shader_uint indexCount;
+  shader_vec3 boxMax;
+  shader_uint firstIndex;
+  shader_uint vertexOffset;
+  // Matches IndexFormat: 0 for 32-bit indices, 1 for 16-bit ones
+  shader_uint indexFormat;
+  shader_uint padding0;
+  shader_uint padding1;
+};
+
+
+#endif // RELEM_DATA_H_INCLUDED
@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+#include <tiny_gltf.h>
+
+#include "scene/Bounds.hpp"
+#include "scene/GltfInstances.hpp"
+
+
+namespace
+{
+
+constexpr float EPSILON = 1e-5f;
+
+int failures = 0;
+
+void expect(bool condition, std::string_view what)
+{
+  if (condition)
+    return;
+  spdlog::error("Check failed: {}", what);
+  ++failures;
+}
+
+bool near(float a, float b, float tolerance = EPSILON)
+{
+  return std::abs(a - b) <= tolerance * std::max(1.0f, std::max(std::abs(a), std::abs(b)));
+}
+
+bool near(glm::vec3 a, glm::vec3 b)
+{
+  return near(a.x, b.x) && near(a.y, b.y) && near(a.z, b.z);
+}
+
+bool is_empty(const Bounds& bounds)
+{
+  return bounds.boxMin.x > bounds.boxMax.x;
+}
+
+// Only the vertices used by the indices count, the rest of the vertex is skipped by the stride
+void test_compute_bounds()
+{
+  struct Vertex
+  {
+    glm::vec3 position;
+    float padding;
+  };
+
+  const std::array<Vertex, 4> vertices{{
+    {{-1.0f, 0.0f, 2.0f}, 0.0f},
+    {{100.0f, 100.0f, 100.0f}, 0.0f},
+    {{3.0f, -2.0f, 2.0f}, 0.0f},
+    {{1.0f, 2.0f, 4.0f}, 0.0f},
+  }};
+  const std::array<std::uint32_t, 6> indices{0, 2, 3, 3, 2, 0};
+
+  const auto bounds =
+    compute_bounds(indices, reinterpret_cast<const std::byte*>(vertices.data()), sizeof(Vertex));
+  expect(near(bounds.boxMin, {-1.0f, -2.0f, 2.0f}), "compute_bounds box min");
+  expect(near(bounds.boxMax, {3.0f, 2.0f, 4.0f}), "compute_bounds box max");
+  expect(near(bounds.sphereCenter, {1.0f, 0.0f, 3.0f}), "compute_bounds sphere center");
+  // The farthest vertices from the center are at (+-2, +-2, +-1)
+  expect(near(bounds.sphereRadius, 3.0f), "compute_bounds sphere radius");
+
+  const auto empty = compute_bounds({}, reinterpret_cast<const std::byte*>(vertices.data()), 0);
+  expect(is_empty(empty), "compute_bounds of no indices is empty");
+  expect(empty.sphereRadius == 0.0f, "compute_bounds of no indices has a zero sphere");
+}
+
+void test_merge_bounds()
+{
+  const std::array<Bounds, 3> parts{{
+    {{0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.5f, 0.5f, 0.5f}, 0.5f},
+    {{2.0f, 0.0f, 0.0f}, {3.0f, 1.0f, 1.0f}, {2.5f, 0.5f, 0.5f}, 0.5f},
+    compute_bounds({}, nullptr, 0),
+  }};
+
+  const auto merged = merge_bounds(parts);
+  expect(near(merged.boxMin, {0.0f, 0.0f, 0.0f}), "merge_bounds box min");
+  expect(near(merged.boxMax, {3.0f, 1.0f, 1.0f}), "merge_bounds box max");
+  expect(near(merged.sphereCenter, {1.5f, 0.5f, 0.5f}), "merge_bounds sphere center");
+  expect(near(merged.sphereRadius, 1.5f), "merge_bounds sphere radius");
+
+  expect(is_empty(merge_bounds({})), "merge_bounds of nothing is empty");
+  expect(
+    is_empty(merge_bounds(std::span(parts).subspan(2))), "merge_bounds of empty bounds is empty");
+}
+
+void test_transform_bounds()
+{
+  const Bounds cube{{-1.0f, -1.0f, -1.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, 1.5f};
+
+  glm::mat4x4 scaleAndMove(1.0f);
+  scaleAndMove[0][0] = 2.0f;
+  scaleAndMove[3] = glm::vec4(5.0f, 0.0f, 0.0f, 1.0f);
+
+  const auto moved = transform_bounds(cube, scaleAndMove);
+  expect(near(moved.boxMin, {3.0f, -1.0f, -1.0f}), "transform_bounds box min");
+  expect(near(moved.boxMax, {7.0f, 1.0f, 1.0f}), "transform_bounds box max");
+  expect(near(moved.sphereCenter, {5.0f, 0.0f, 0.0f}), "transform_bounds sphere center");
+  expect(near(moved.sphereRadius, 3.0f), "transform_bounds sphere radius uses the max scale");
+
+  // 45 degrees around z
+  const float c = std::sqrt(0.5f);
+  glm::mat4x4 rotation(1.0f);
+  rotation[0] = glm::vec4(c, c, 0.0f, 0.0f);
+  rotation[1] = glm::vec4(-c, c, 0.0f, 0.0f);
+
+  const auto rotated = transform_bounds(cube, rotation);
+  const float diagonal = std::sqrt(2.0f);
+  expect(near(rotated.boxMin, {-diagonal, -diagonal, -1.0f}), "rotated box min");
+  expect(near(rotated.boxMax, {diagonal, diagonal, 1.0f}), "rotated box max");
+  expect(near(rotated.sphereRadius, 1.5f), "rotation keeps the sphere radius");
+
+  expect(
+    is_empty(transform_bounds(compute_bounds({}, nullptr, 0), scaleAndMove)),
+    "transform_bounds keeps empty bounds empty");
+}
+
+bool skip_image_loading(
+  tinygltf::Image*,
+  const int,
+  std::string*,
+  std::string*,
+  int,
+  int,
+  const unsigned char*,
+  int,
+  void*)
+{
+  return true;
+}
+
+std::optional<tinygltf::Model> load_model(const std::filesystem::path& path)
+{
+  tinygltf::TinyGLTF loader;
+  loader.SetImageLoader(skip_image_loading, nullptr);
+
+  tinygltf::Model model;
+  std::string error;
+  std::string warning;
+  if (!loader.LoadASCIIFromFile(&model, &error, &warning, path.string()))
+  {
+    spdlog::warn("Skipping {}, it failed to load: {}", path, error);
+    return std::nullopt;
+  }
+
+  return model;
+}
+
+struct Primitive
+{
+  std::vector<std::uint32_t> indices;
+  const std::byte* positions;
+  std::size_t stride;
+};
+
+// Same primitives as the ones SceneManager turns into relems
+std::vector<Primitive> gather_primitives(const tinygltf::Model& model, const tinygltf::Mesh& mesh)
+{
+  std::vector<Primitive> result;
+  for (const auto& prim : mesh.primitives)
+  {
+    if (prim.mode != TINYGLTF_MODE_TRIANGLES || prim.indices < 0)
+      continue;
+
+    // NOTE: quantized positions of baked scenes are not handled here
+    const auto& positionAccessor = model.accessors[prim.attributes.at("POSITION")];
+    if (positionAccessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT)
+      continue;
+
+    const auto& positionView = model.bufferViews[positionAccessor.bufferView];
+
+    const auto& indexAccessor = model.accessors[prim.indices];
+    const auto& indexView = model.bufferViews[indexAccessor.bufferView];
+    const auto* indexData = model.buffers[indexView.buffer].data.data() + indexView.byteOffset +
+      indexAccessor.byteOffset;
+    const auto indexSize =
+      static_cast<std::size_t>(tinygltf::GetComponentSizeInBytes(indexAccessor.componentType));
+
+    const auto* positionData = model.buffers[positionView.buffer].data.data() +
+      positionView.byteOffset + positionAccessor.byteOffset;
+
+    auto& dst = result.emplace_back(Primitive{
+      .indices = std::vector<std::uint32_t>(indexAccessor.count),
+      .positions = reinterpret_cast<const std::byte*>(positionData),
+      .stride = positionView.byteStride != 0 ? positionView.byteStride : sizeof(glm::vec3),
+    });
+
+    // NOTE: glTF indices are little-endian, just like every platform we run on
+    for (std::size_t i = 0; i < indexAccessor.count; ++i)
+      std::memcpy(&dst.indices[i], indexData + i * indexSize, indexSize);
+  }
+  return result;
+}
+
+// Every vertex of every instance must be inside of the world space bounds of the instance
+bool test_scene(const std::filesystem::path& path)
+{
+  const auto model = load_model(path);
+  if (!model.has_value())
+    return false;
+
+  std::vector<std::vector<Primitive>> primitives;
+  std::vector<Bounds> meshBounds;
+  for (const auto& mesh : model->meshes)
+  {
+    auto& meshPrimitives = primitives.emplace_back(gather_primitives(*model, mesh));
+
+    std::vector<Bounds> relemBounds;
+    for (const auto& prim : meshPrimitives)
+      relemBounds.push_back(compute_bounds(prim.indices, prim.positions, prim.stride));
+    meshBounds.push_back(merge_bounds(relemBounds));
+  }
+
+  const auto instances = flatten_instances(*model);
+
+  std::size_t checkedVertices = 0;
+  std::size_t outsideVertices = 0;
+  for (std::size_t i = 0; i < instances.matrices.size(); ++i)
+  {
+    const auto& matrix = instances.matrices[i];
+    const auto bounds = transform_bounds(meshBounds[instances.meshes[i]], matrix);
+
+    // NOTE: transforming vertices and boxes rounds differently, so allow for a bit of slack
+    const float tolerance = EPSILON *
+      std::max({1.0f,
+                glm::length(bounds.boxMin),
+                glm::length(bounds.boxMax),
+                glm::length(bounds.sphereCenter) + bounds.sphereRadius});
+
+    for (const auto& prim : primitives[instances.meshes[i]])
+      for (auto index : prim.indices)
+      {
+        glm::vec3 position;
+        std::memcpy(&position, prim.positions + index * prim.stride, sizeof(position));
+        const glm::vec3 world = glm::vec3(matrix * glm::vec4(position, 1.0f));
+
+        const bool insideBox = glm::all(glm::greaterThanEqual(world, bounds.boxMin - tolerance)) &&
+          glm::all(glm::lessThanEqual(world, bounds.boxMax + tolerance));
+        const bool insideSphere =
+          glm::length(world - bounds.sphereCenter) <= bounds.sphereRadius + tolerance;
+
+        ++checkedVertices;
+        if (insideBox && insideSphere)
+          continue;
+
+        if (outsideVertices++ < 8)
+          spdlog::error(
+            "{}: vertex ({}, {}, {}) of instance {} is outside of its bounds",
+            path,
+            world.x,
+            world.y,
+            world.z,
+            i);
+      }
+  }
+
+  spdlog::info(
+    "{}: checked {} vertices of {} instances",
+    path.filename(),
+    checkedVertices,
+    instances.matrices.size());
+  expect(outsideVertices == 0, "scene vertices are inside of their instance bounds");
+
+  return true;
+}
+
+} // namespace
+
+int main()
+{
+  test_compute_bounds();
+  test_merge_bounds();
+  test_transform_bounds();
+
+  const std::filesystem::path scenes = GRAPHICS_COURSE_RESOURCES_ROOT "/scenes";
+
+  // NOTE: the binary buffers of large scenes may be missing from a checkout, only require
+  // that at least some of the scenes were actually checked.
+  int testedScenes = 0;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(scenes))
+    if (entry.path().extension() == ".gltf")
+      testedScenes += test_scene(entry.path()) ? 1 : 0;
+  expect(testedScenes > 0, "at least one scene from resources/scenes was loaded");
+
+  if (failures != 0)
+  {
+    spdlog::error("{} checks failed", failures);
+    return 1;
+  }
+
+  return 0;
+}
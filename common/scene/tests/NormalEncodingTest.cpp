@@ -0,0 +1,129 @@
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "scene/NormalEncoding.hpp"
+
+
+namespace
+{
+
+constexpr std::size_t NORMAL_COUNT = NORMAL_BATCH_SIZE << 17;
+constexpr int BENCHMARK_REPEATS = 16;
+
+// Same SoA layout as the one encode_normals expects
+struct alignas(32) NormalBatch
+{
+  float xs[NORMAL_BATCH_SIZE];
+  float ys[NORMAL_BATCH_SIZE];
+  float zs[NORMAL_BATCH_SIZE];
+};
+
+struct alignas(32) EncodedBatch
+{
+  std::uint32_t values[NORMAL_BATCH_SIZE];
+};
+
+// Random unit vectors, with the batches at the front covering the corner cases
+std::vector<NormalBatch> generate_normals()
+{
+  std::vector<NormalBatch> result(NORMAL_COUNT / NORMAL_BATCH_SIZE);
+  std::size_t count = 0;
+  auto push = [&result, &count](glm::vec3 normal) {
+    auto& batch = result[count / NORMAL_BATCH_SIZE];
+    batch.xs[count % NORMAL_BATCH_SIZE] = normal.x;
+    batch.ys[count % NORMAL_BATCH_SIZE] = normal.y;
+    batch.zs[count % NORMAL_BATCH_SIZE] = normal.z;
+    ++count;
+  };
+
+  for (float x : {-1.0f, -0.0f, 0.0f, 1.0f})
+    for (float y : {-1.0f, -0.0f, 0.0f, 1.0f})
+      for (float z : {-1.0f, -0.0f, 0.0f, 1.0f})
+        push(glm::vec3(x, y, z));
+
+  std::mt19937 rng(42);
+  std::normal_distribution<float> distribution;
+  while (count < NORMAL_COUNT)
+  {
+    const glm::vec3 v(distribution(rng), distribution(rng), distribution(rng));
+    if (glm::dot(v, v) > 1e-12f)
+      push(glm::normalize(v));
+  }
+
+  return result;
+}
+
+template <class F>
+double measure_mb_per_second(F&& encode)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCHMARK_REPEATS; ++i)
+    encode();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  const double bytes = double(NORMAL_COUNT) * BENCHMARK_REPEATS * sizeof(glm::vec3);
+  return bytes / (1 << 20) / elapsed.count();
+}
+
+} // namespace
+
+int main()
+{
+  const auto normals = generate_normals();
+
+  std::vector<EncodedBatch> scalar(normals.size());
+  auto encodeScalar = [&]() {
+    for (std::size_t i = 0; i < normals.size(); ++i)
+    {
+      const auto& batch = normals[i];
+      for (std::size_t j = 0; j < NORMAL_BATCH_SIZE; ++j)
+        scalar[i].values[j] = encode_normal(glm::vec3(batch.xs[j], batch.ys[j], batch.zs[j]));
+    }
+  };
+
+  std::vector<EncodedBatch> batched(normals.size());
+  auto encodeBatched = [&]() {
+    for (std::size_t i = 0; i < normals.size(); ++i)
+      encode_normals(normals[i].xs, normals[i].ys, normals[i].zs, batched[i].values);
+  };
+
+  const double scalarSpeed = measure_mb_per_second(encodeScalar);
+  const double batchedSpeed = measure_mb_per_second(encodeBatched);
+
+  std::size_t mismatches = 0;
+  for (std::size_t i = 0; i < normals.size(); ++i)
+    for (std::size_t j = 0; j < NORMAL_BATCH_SIZE; ++j)
+    {
+      const std::uint32_t expected = scalar[i].values[j];
+      const std::uint32_t actual = batched[i].values[j];
+      if (actual == expected)
+        continue;
+      if (mismatches++ < 8)
+        spdlog::error(
+          "Normal ({}, {}, {}) is encoded as {:#010x}, expected {:#010x}",
+          normals[i].xs[j],
+          normals[i].ys[j],
+          normals[i].zs[j],
+          actual,
+          expected);
+    }
+
+  spdlog::info(
+    "Encoded {} normals: scalar {:.1f} MB/s, batched {:.1f} MB/s ({:.2f}x)",
+    NORMAL_COUNT,
+    scalarSpeed,
+    batchedSpeed,
+    batchedSpeed / scalarSpeed);
+
+  if (mismatches != 0)
+  {
+    spdlog::error("{} of {} normals differ from the reference encoding", mismatches, NORMAL_COUNT);
+    return 1;
+  }
+
+  return 0;
+}
@@ -26,12 +26,26 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+  // NOTE: GPU culling writes a variable amount of draws, each for its own instance,
+  // and cascades of the shadow map are layers picked by the vertex shader.
+  // Shaders are built for Vulkan 1.0, where gl_Layer comes from an extension
+  // that needs both output features.
+  vk::PhysicalDeviceVulkan12Features vulkan12Features{
+    .drawIndirectCount = VK_TRUE,
+    .shaderOutputViewportIndex = VK_TRUE,
+    .shaderOutputLayer = VK_TRUE,
+  };
+
   etna::initialize(etna::InitParams{
     .applicationName = "ShadowmapSample",
     .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
     .instanceExtensions = instanceExtensions,
     .deviceExtensions = deviceExtensions,
-    .features = vk::PhysicalDeviceFeatures2{.features = {}},
+    .features =
+      vk::PhysicalDeviceFeatures2{
+        .pNext = &vulkan12Features,
+        .features = {.drawIndirectFirstInstance = VK_TRUE, .depthClamp = VK_TRUE},
+      },
     // Replace with an index if etna detects your preferred GPU incorrectly
     .physicalDeviceIndexOverride = {},
     // How much frames we buffer on the GPU without waiting for their completion on the CPU
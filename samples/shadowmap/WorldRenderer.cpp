@@ -1,5 +1,13 @@
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <string>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/RenderTargetStates.hpp>
@@ -7,9 +15,38 @@
 #include <glm/ext.hpp>
 #include <imgui.h>
 
+#include "shaders/CullingParams.h"
+
+
+namespace
+{
+
+// Binding of the instance buffer in set 0, see simple.vert
+constexpr std::uint32_t INSTANCES_BINDING = 2;
+
+constexpr std::uint32_t CULLING_GROUP_SIZE = 64;
+
+// One draw region and count per IndexFormat
+constexpr std::size_t INDEX_FORMAT_COUNT = 2;
+
+// Occluders are taken from the largest instances on screen until this runs out,
+// which bounds the time spent on rasterizing them
+constexpr std::size_t MAX_OCCLUDER_TRIANGLES = 8192;
+// Bounding sphere radius over the distance, smaller instances hide too little to be worth it
+constexpr float MIN_OCCLUDER_SIZE = 0.05f;
+
+// How far toward the light casters are kept, in depths of the light frustum
+constexpr float CASTER_DEPTH_EXTENSION = 16.0f;
+
+// Resolution of every cascade of the shadow map
+constexpr std::uint32_t SHADOW_MAP_SIZE = 2048;
+
+} // namespace
 
 WorldRenderer::WorldRenderer()
   : sceneMgr{std::make_unique<SceneManager>()}
+  , jobPool{std::make_unique<ThreadPool>()}
+  , parallelRecorder{std::make_unique<ParallelRecorder>(*jobPool)}
 {
 }
 
@@ -23,15 +60,31 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
     .extent = vk::Extent3D{resolution.x, resolution.y, 1},
     .name = "main_view_depth",
     .format = vk::Format::eD32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+    .imageUsage =
+      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+  });
+
+  depthPyramidSize = {
+    std::bit_ceil((resolution.x + 1) / 2),
+    std::bit_ceil((resolution.y + 1) / 2),
+  };
+  depthPyramidLevels =
+    static_cast<std::uint32_t>(std::bit_width(std::max(depthPyramidSize.x, depthPyramidSize.y)));
+  depthPyramid = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{depthPyramidSize.x, depthPyramidSize.y, 1},
+    .name = "depth_pyramid",
+    .format = vk::Format::eR32Sfloat,
+    .imageUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+    .mipLevels = depthPyramidLevels,
   });
 
   shadowMap = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{2048, 2048, 1},
+    .extent = vk::Extent3D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1},
     .name = "shadow_map",
     .format = vk::Format::eD16Unorm,
     .imageUsage =
       vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+    .layers = SHADOW_CASCADE_COUNT,
   });
 
   defaultSampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "default_sampler"});
@@ -47,7 +100,8 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
-  sceneMgr->selectScene(path);
+  // NOTE: the scene appears once it is fully uploaded, until then nothing is drawn
+  sceneMgr->selectSceneAsync(path);
 }
 
 void WorldRenderer::loadShaders()
@@ -56,10 +110,14 @@ void WorldRenderer::loadShaders()
     "simple_material",
     {SHADOWMAP_SHADERS_ROOT "simple_shadow.frag.spv", SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
   etna::create_program("simple_shadow", {SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
+  etna::create_program("culling", {SHADOWMAP_SHADERS_ROOT "culling.comp.spv"});
+  etna::create_program("depth_reduce", {SHADOWMAP_SHADERS_ROOT "depth_reduce.comp.spv"});
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
+  swapchainFormat = swapchain_format;
+
   quadRenderer = std::make_unique<QuadRenderer>(QuadRenderer::CreateInfo{
     .format = swapchain_format,
     .rect = {{0, 0}, {512, 512}},
@@ -100,6 +158,9 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
       .vertexShaderInput = sceneVertexInputDesc,
       .rasterizationConfig =
         vk::PipelineRasterizationStateCreateInfo{
+          // NOTE: casters between the light and the near plane are kept by culling,
+          // clamping flattens them onto it instead of clipping them away
+          .depthClampEnable = VK_TRUE,
           .polygonMode = vk::PolygonMode::eFill,
           .cullMode = vk::CullModeFlagBits::eBack,
           .frontFace = vk::FrontFace::eCounterClockwise,
@@ -110,6 +171,12 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
           .depthAttachmentFormat = vk::Format::eD16Unorm,
         },
     });
+
+  cullingPipeline = {};
+  cullingPipeline = pipelineManager.createComputePipeline("culling", {});
+
+  depthReducePipeline = {};
+  depthReducePipeline = pipelineManager.createComputePipeline("depth_reduce", {});
 }
 
 void WorldRenderer::debugInput(const Keyboard& kb)
@@ -125,33 +192,30 @@ void WorldRenderer::update(const FramePacket& packet)
 {
   ZoneScoped;
 
+  sceneMgr->update();
+  updateGpuDrawLists();
+
   // calc camera matrix
   {
     const float aspect = float(resolution.x) / float(resolution.y);
     worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
   }
 
-  // calc light matrix
+  if (usesSoftwareOcclusion())
+    updateOcclusionBuffer();
+
+  // calc light matrices
   {
-    const auto mProj = lightProps.usePerspectiveM
-      ? glm::perspectiveLH_ZO(
-          -glm::radians(packet.shadowCam.fov), 1.0f, 1.0f, lightProps.lightTargetDist * 2.0f)
-      : glm::orthoLH_ZO(
-          +lightProps.radius,
-          -lightProps.radius,
-          +lightProps.radius,
-          -lightProps.radius,
-          0.0f,
-          lightProps.lightTargetDist);
-
-    lightMatrix = mProj * packet.shadowCam.viewTm();
+    updateCascades(packet);
 
     lightPos = packet.shadowCam.position;
   }
 
   // Upload everything to GPU-mapped memory
   {
-    uniformParams.lightMatrix = lightMatrix;
+    std::copy(
+      cascadeMatrices.begin(), cascadeMatrices.end(), std::begin(uniformParams.cascadeMatrices));
+    uniformParams.cascadeCount = cascadeCount;
     uniformParams.lightPos = lightPos;
     uniformParams.time = packet.currentTime;
 
@@ -159,59 +223,661 @@ void WorldRenderer::update(const FramePacket& packet)
   }
 }
 
-void WorldRenderer::renderScene(
-  vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
+void WorldRenderer::updateCascades(const FramePacket& packet)
+{
+  const glm::mat4x4 lightView = packet.shadowCam.viewTm();
+
+  // Casters are culled with the cascade frustum extended toward the light, and cropped
+  // to the part of the view it covers when only casters with visible shadows are wanted.
+  // NOTE: cropping a frustum to itself only extends it.
+  auto casterMatrix = [&](const glm::mat4x4& cascade, const glm::mat4x4& view) {
+    return crop_to_receivers(cascade, cullShadowCasters ? view : cascade, CASTER_DEPTH_EXTENSION);
+  };
+
+  // NOTE: a perspective light doesn't shine along a single direction, so its shadows
+  // are not split into cascades, the whole frustum of the light goes into the first one
+  if (lightProps.usePerspectiveM)
+  {
+    cascadeCount = 1;
+    cascadeMatrices[0] = glm::perspectiveLH_ZO(
+                           -glm::radians(packet.shadowCam.fov),
+                           1.0f,
+                           1.0f,
+                           lightProps.lightTargetDist * 2.0f) *
+      lightView;
+    casterMatrices[0] = casterMatrix(cascadeMatrices[0], worldViewProj);
+    return;
+  }
+
+  cascadeCount = static_cast<std::uint32_t>(lightProps.cascadeCount);
+
+  const auto& cam = packet.mainCam;
+  const float aspect = float(resolution.x) / float(resolution.y);
+  const float shadowFar = std::min(cam.zFar, lightProps.shadowDistance);
+
+  float sliceNear = cam.zNear;
+  for (std::uint32_t i = 0; i < cascadeCount; ++i)
+  {
+    // Logarithmic splits keep texels of all cascades about the same size on screen,
+    // but make the first ones tiny with a close near plane, so they are blended with uniform ones
+    const float t = float(i + 1) / float(cascadeCount);
+    const float sliceFar = glm::mix(
+      cam.zNear + (shadowFar - cam.zNear) * t,
+      cam.zNear * std::pow(shadowFar / cam.zNear, t),
+      lightProps.splitBlend);
+    const glm::mat4x4 sliceViewProj =
+      glm::perspectiveLH_ZO(-glm::radians(cam.fov), aspect, sliceNear, sliceFar) * cam.viewTm();
+    sliceNear = sliceFar;
+
+    // The bounding sphere of the slice keeps its size as the camera turns, and so do texels
+    const glm::mat4x4 sliceToWorld = glm::inverse(sliceViewProj);
+    std::array<glm::vec3, 8> corners;
+    glm::vec3 center{0.0f};
+    for (int j = 0; j < 8; ++j)
+    {
+      const glm::vec4 ndc{j & 1 ? 1.0f : -1.0f, j & 2 ? 1.0f : -1.0f, j & 4 ? 1.0f : 0.0f, 1.0f};
+      const glm::vec4 corner = sliceToWorld * ndc;
+      corners[j] = glm::vec3(corner) / corner.w;
+      center += corners[j] / 8.0f;
+    }
+    float radius = 0.0f;
+    for (const auto& corner : corners)
+      radius = std::max(radius, glm::length(corner - center));
+    // NOTE: otherwise rounding errors make it change a bit every frame
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // Moving the cascade by whole texels keeps shadow edges from crawling as the camera moves
+    const float texelSize = 2.0f * radius / float(SHADOW_MAP_SIZE);
+    glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+    lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+    lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+    cascadeMatrices[i] = glm::orthoLH_ZO(
+                           lightCenter.x + radius,
+                           lightCenter.x - radius,
+                           lightCenter.y + radius,
+                           lightCenter.y - radius,
+                           lightCenter.z - radius,
+                           lightCenter.z + radius) *
+      lightView;
+    casterMatrices[i] = casterMatrix(cascadeMatrices[i], sliceViewProj);
+  }
+}
+
+void WorldRenderer::updateOcclusionBuffer()
+{
+  ZoneScopedN("softwareOcclusion");
+
+  occlusionBuffer.clear(worldViewProj);
+
+  const auto bounds = sceneMgr->getInstanceBounds();
+  const auto matrices = sceneMgr->getInstanceMatrices();
+  const auto instanceMeshes = sceneMgr->getInstanceMeshes();
+  const auto& occluders = sceneMgr->getOccluders();
+
+  // NOTE: visibleInstances is only scratch space here, every pass culls into it anew
+  visibleInstances.clear();
+  sceneMgr->getInstanceBvh().cullFrustum(extract_frustum(worldViewProj), visibleInstances);
+
+  occluderCandidates.clear();
+  for (auto instance : visibleInstances)
+  {
+    if (occluders.meshes[instanceMeshes[instance]].indexCount == 0)
+      continue;
+
+    // W of the center is its distance along the view direction, the camera may be inside
+    const auto& sphere = bounds[instance];
+    const float distance = (worldViewProj * glm::vec4(sphere.sphereCenter, 1.0f)).w;
+    const float size = sphere.sphereRadius / std::max(distance, sphere.sphereRadius);
+    if (size >= MIN_OCCLUDER_SIZE)
+      occluderCandidates.emplace_back(size, instance);
+  }
+  std::sort(occluderCandidates.begin(), occluderCandidates.end(), std::greater{});
+
+  std::size_t triangleCount = 0;
+  for (const auto& [size, instance] : occluderCandidates)
+  {
+    const auto& mesh = occluders.meshes[instanceMeshes[instance]];
+    // NOTE: smaller candidates further on may still fit
+    if (triangleCount + mesh.indexCount / 3 > MAX_OCCLUDER_TRIANGLES)
+      continue;
+    triangleCount += mesh.indexCount / 3;
+
+    occlusionBuffer.addOccluder(
+      std::span{occluders.vertices}.subspan(mesh.vertexOffset, mesh.vertexCount),
+      std::span{occluders.indices}.subspan(mesh.indexOffset, mesh.indexCount),
+      matrices[instance]);
+  }
+
+  occlusionBuffer.rasterize(jobPool.get());
+}
+
+void WorldRenderer::updateGpuDrawLists()
 {
-  if (!sceneMgr->getVertexBuffer())
+  std::erase_if(
+    retiredDrawLists, [](RetiredDrawLists& retired) { return retired.framesLeft-- == 0; });
+
+  if (sceneMgr->getSceneVersion() == gpuDrawSceneVersion)
+    return;
+  gpuDrawSceneVersion = sceneMgr->getSceneVersion();
+
+  // NOTE: what was visible in the previous scene says nothing about the new one
+  mainVisibilityValid = false;
+
+  const std::size_t capacity = sceneMgr->getRelemInstances().size();
+  if (capacity == gpuDrawCapacity)
     return;
 
+  // NOTE: old lists may still be read by frames in flight, so they are kept until those finish
+  retiredDrawLists.push_back(RetiredDrawLists{
+    .shadowDraws = std::move(shadowDraws),
+    .mainDraws = std::move(mainDraws),
+    .mainVisibility = std::move(mainVisibility),
+    .framesLeft = etna::get_context().getMainWorkCount().multiBufferingCount() + 1,
+  });
+
+  gpuDrawCapacity = capacity;
+  shadowDraws = {};
+  mainDraws = {};
+  mainVisibility = {};
+  if (capacity == 0)
+    return;
+
+  auto create = [capacity](const char* commands_name, const char* counts_name) {
+    auto& ctx = etna::get_context();
+    return GpuDrawList{
+      .commands = ctx.createBuffer(etna::Buffer::CreateInfo{
+        .size = INDEX_FORMAT_COUNT * capacity * sizeof(vk::DrawIndexedIndirectCommand),
+        .bufferUsage =
+          vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+        .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+        .name = commands_name,
+      }),
+      .counts = ctx.createBuffer(etna::Buffer::CreateInfo{
+        .size = INDEX_FORMAT_COUNT * sizeof(std::uint32_t),
+        .bufferUsage = vk::BufferUsageFlagBits::eIndirectBuffer |
+          vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+        .name = counts_name,
+      }),
+    };
+  };
+  for (std::size_t i = 0; i < shadowDraws.size(); ++i)
+    shadowDraws[i] = create(
+      ("shadow_draw_commands_" + std::to_string(i)).c_str(),
+      ("shadow_draw_counts_" + std::to_string(i)).c_str());
+  mainDraws = create("main_draw_commands", "main_draw_counts");
+
+  mainVisibility = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = capacity * sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "main_visibility",
+  });
+}
+
+void WorldRenderer::cullOnGpu(
+  vk::CommandBuffer cmd_buf,
+  const glm::mat4x4& glob_tm,
+  const GpuDrawList& draws,
+  std::uint32_t pass)
+{
+  if (gpuDrawCapacity == 0 || !sceneMgr->getRelemInstanceBuffer().get())
+    return;
+
+  ETNA_PROFILE_GPU(cmd_buf, cullOnGpu);
+
+  // The list may still be used by the previous frame, whose culling passes also wrote
+  // the draw counts and the visibility bits read by this frame's early pass
+  {
+    const vk::MemoryBarrier2 barrier{
+      .srcStageMask =
+        vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask =
+        vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eTransferWrite |
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  }
+
+  cmd_buf.fillBuffer(draws.counts.get(), 0, vk::WholeSize, 0);
+
+  // Nothing is known to be visible for a new scene, so the early pass draws nothing at first
+  if (!mainVisibilityValid)
+  {
+    cmd_buf.fillBuffer(mainVisibility.get(), 0, vk::WholeSize, 0);
+    mainVisibilityValid = true;
+  }
+
+  {
+    const vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead |
+        vk::AccessFlagBits2::eShaderStorageWrite,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  }
+
+  auto set = etna::create_descriptor_set(
+    etna::get_shader_program("culling").getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, sceneMgr->getInstanceBuffer().genBinding()},
+      etna::Binding{1, sceneMgr->getRelemBuffer().genBinding()},
+      etna::Binding{2, sceneMgr->getRelemInstanceBuffer().genBinding()},
+      etna::Binding{3, draws.commands.genBinding()},
+      etna::Binding{4, draws.counts.genBinding()},
+      // NOTE: these are only used by occlusion passes, but have to be bound regardless
+      etna::Binding{5, mainVisibility.genBinding()},
+      etna::Binding{
+        6, depthPyramid.genBinding(defaultSampler.get(), vk::ImageLayout::eGeneral)},
+    });
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, cullingPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    cullingPipeline.getVkPipelineLayout(),
+    0,
+    {set.getVkSet()},
+    {});
+
+  const CullingParams params{
+    .viewProj = glob_tm,
+    .relemInstanceCount = static_cast<std::uint32_t>(gpuDrawCapacity),
+    .drawRegionSize = static_cast<std::uint32_t>(gpuDrawCapacity),
+    .pass = pass,
+    .depthPyramidLevels = depthPyramidLevels,
+    .depthSize = resolution,
+  };
+  cmd_buf.pushConstants<CullingParams>(
+    cullingPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {params});
+
+  etna::flush_barriers(cmd_buf);
+
+  const auto groupCount =
+    static_cast<std::uint32_t>((gpuDrawCapacity + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE);
+  cmd_buf.dispatch(groupCount, 1, 1);
+
+  {
+    const vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      // NOTE: besides the draws, the results are used by later culling passes and
+      // get cleared at the start of the next frame
+      .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect |
+        vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eTransfer,
+      .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead |
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite |
+        vk::AccessFlagBits2::eTransferWrite,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  }
+}
+
+void WorldRenderer::buildDepthPyramid(vk::CommandBuffer cmd_buf)
+{
+  ETNA_PROFILE_GPU(cmd_buf, buildDepthPyramid);
+
+  auto programInfo = etna::get_shader_program("depth_reduce");
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, depthReducePipeline.getVkPipeline());
+
+  glm::uvec2 srcSize = resolution;
+  for (std::uint32_t level = 0; level < depthPyramidLevels; ++level)
+  {
+    const glm::uvec2 dstSize{
+      std::max(depthPyramidSize.x >> level, 1u), std::max(depthPyramidSize.y >> level, 1u)};
+
+    auto src = level == 0
+      ? mainViewDepth.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)
+      : depthPyramid.genBinding(
+          defaultSampler.get(),
+          vk::ImageLayout::eGeneral,
+          {.baseMip = level - 1, .levelCount = 1});
+
+    auto set = etna::create_descriptor_set(
+      programInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, src},
+        etna::Binding{
+          1,
+          depthPyramid.genBinding(
+            {}, vk::ImageLayout::eGeneral, {.baseMip = level, .levelCount = 1})},
+      });
+
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      depthReducePipeline.getVkPipelineLayout(),
+      0,
+      {set.getVkSet()},
+      {});
+
+    const DepthReduceParams params{.srcSize = srcSize, .dstSize = dstSize};
+    cmd_buf.pushConstants<DepthReduceParams>(
+      depthReducePipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {params});
+
+    etna::flush_barriers(cmd_buf);
+
+    cmd_buf.dispatch((dstSize.x + 7) / 8, (dstSize.y + 7) / 8, 1);
+
+    // The next level reads this one, and the late culling pass reads all of them
+    const vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+
+    srcSize = dstSize;
+  }
+}
+
+std::optional<etna::DescriptorSet> WorldRenderer::createSceneSet(
+  vk::CommandBuffer cmd_buf, const char* program_name, std::vector<etna::Binding> bindings)
+{
+  if (!sceneMgr->getVertexBuffer() || !sceneMgr->getInstanceBuffer().get())
+    return std::nullopt;
+
+  bindings.push_back(etna::Binding{INSTANCES_BINDING, sceneMgr->getInstanceBuffer().genBinding()});
+
+  return etna::create_descriptor_set(
+    etna::get_shader_program(program_name).getDescriptorLayoutId(0), cmd_buf, std::move(bindings));
+}
+
+void WorldRenderer::bindScene(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineLayout pipeline_layout,
+  const etna::DescriptorSet& scene_set)
+{
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, {scene_set.getVkSet()}, {});
+
   cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
+}
+
+void WorldRenderer::pushLayer(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineLayout pipeline_layout,
+  const glm::mat4x4& glob_tm,
+  std::uint32_t layer)
+{
+  // NOTE: model matrices come from the instance buffer, so there is one push per layer
+  const PushConstants pushConst{.projView = glob_tm, .layer = layer};
+  cmd_buf.pushConstants<PushConstants>(
+    pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst});
+}
+
+void WorldRenderer::renderScene(
+  vk::CommandBuffer cmd_buf,
+  std::span<const glm::mat4x4> layer_tms,
+  vk::PipelineLayout pipeline_layout,
+  const std::optional<etna::DescriptorSet>& scene_set,
+  std::span<const GpuDrawList> gpu_draws)
+{
+  if (!scene_set.has_value())
+    return;
+
+  if (culling != Culling::Gpu)
+  {
+    recordDraws(cmd_buf, layer_tms, pipeline_layout, *scene_set, 0, drawList.size());
+    return;
+  }
+
+  if (gpuDrawCapacity == 0)
+    return;
 
-  pushConst2M.projView = glob_tm;
+  bindScene(cmd_buf, pipeline_layout, *scene_set);
 
-  auto instanceMeshes = sceneMgr->getInstanceMeshes();
-  auto instanceMatrices = sceneMgr->getInstanceMatrices();
+  for (std::uint32_t layer = 0; layer < layer_tms.size(); ++layer)
+  {
+    pushLayer(cmd_buf, pipeline_layout, layer_tms[layer], layer);
+
+    // NOTE: region sizes are an upper bound, actual counts were written by culling.comp
+    const auto& draws = gpu_draws[layer];
+    for (std::size_t format = 0; format < INDEX_FORMAT_COUNT; ++format)
+    {
+      const auto indexFormat = static_cast<IndexFormat>(format);
+      if (!sceneMgr->getIndexBuffer(indexFormat))
+        continue;
+      cmd_buf.bindIndexBuffer(
+        sceneMgr->getIndexBuffer(indexFormat), 0, SceneManager::getIndexType(indexFormat));
+      cmd_buf.drawIndexedIndirectCount(
+        draws.commands.get(),
+        format * gpuDrawCapacity * sizeof(vk::DrawIndexedIndirectCommand),
+        draws.counts.get(),
+        format * sizeof(std::uint32_t),
+        static_cast<std::uint32_t>(gpuDrawCapacity),
+        sizeof(vk::DrawIndexedIndirectCommand));
+    }
+  }
+}
 
-  auto meshes = sceneMgr->getMeshes();
-  auto relems = sceneMgr->getRenderElements();
+void WorldRenderer::buildDrawList(
+  std::span<const glm::mat4x4> cull_tms, const OcclusionBuffer* occlusion, bool front_to_back)
+{
+  ZoneScopedN("buildDrawList");
+
+  const auto relems = sceneMgr->getRenderElements();
+  const auto bounds = sceneMgr->getInstanceBounds();
+  drawList.clear();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  // Every layer gets its own list of draws, sorting puts them one after another
+  for (std::uint32_t layer = 0; layer < cull_tms.size(); ++layer)
   {
-    pushConst2M.model = instanceMatrices[instIdx];
+    // NOTE: every pass culls against its own frustum, the light sees different parts of the scene
+    const auto& cullTm = cull_tms[layer];
+    const auto frustum = extract_frustum(cullTm);
+
+    auto addDraw = [&](std::uint32_t relem_idx, std::uint32_t instance) {
+      const float viewDepth = (cullTm * glm::vec4(bounds[instance].sphereCenter, 1.0f)).w;
+      // NOTE: every pass has a single pipeline and relems have no materials yet
+      drawList.add(
+        DrawKey{
+          .layer = layer,
+          .pipeline = 0,
+          .material = 0,
+          .depthBucket = front_to_back ? DrawList::getDepthBucket(viewDepth) : 0,
+          .indexFormat = static_cast<std::uint32_t>(relems[relem_idx].indexFormat),
+          .relem = relem_idx,
+        },
+        instance);
+    };
 
-    cmd_buf.pushConstants<PushConstants>(
-      pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
+    if (culling == Culling::InstanceBvh)
+    {
+      visibleInstances.clear();
+      {
+        ZoneScopedN("bvhCulling");
+        sceneMgr->getInstanceBvh().cullFrustum(frustum, visibleInstances);
+        std::sort(visibleInstances.begin(), visibleInstances.end());
+      }
+
+      if (occlusion != nullptr)
+      {
+        ZoneScopedN("occlusionTest");
+        std::erase_if(visibleInstances, [&](std::uint32_t instance) {
+          return !occlusion->isVisible(bounds[instance].boxMin, bounds[instance].boxMax);
+        });
+      }
+
+      const auto instanceMeshes = sceneMgr->getInstanceMeshes();
+      const auto meshes = sceneMgr->getMeshes();
+      for (auto instance : visibleInstances)
+      {
+        const auto& mesh = meshes[instanceMeshes[instance]];
+        for (std::uint32_t j = 0; j < mesh.relemCount; ++j)
+          addDraw(mesh.firstRelem + j, instance);
+      }
+    }
+    else
+    {
+      const auto relemInstances = sceneMgr->getRelemInstances();
+      visibleRelemInstances.clear();
+      if (culling == Culling::RelemBoxes)
+      {
+        ZoneScopedN("frustumCulling");
+        cull_boxes(frustum, sceneMgr->getRelemInstanceBoxes(), visibleRelemInstances);
+      }
+      else
+      {
+        visibleRelemInstances.resize(relemInstances.size());
+        std::iota(visibleRelemInstances.begin(), visibleRelemInstances.end(), 0u);
+      }
+
+      if (occlusion != nullptr)
+      {
+        ZoneScopedN("occlusionTest");
+        // NOTE: the instance box encloses all of its relems, which keeps the test conservative
+        std::erase_if(visibleRelemInstances, [&](std::uint32_t relem_instance) {
+          const auto& box = bounds[relemInstances[relem_instance].instance];
+          return !occlusion->isVisible(box.boxMin, box.boxMax);
+        });
+      }
+
+      for (auto idx : visibleRelemInstances)
+        addDraw(relemInstances[idx].relem, relemInstances[idx].instance);
+    }
+  }
 
-    const auto meshIdx = instanceMeshes[instIdx];
+  {
+    ZoneScopedN("sortDraws");
+    drawList.sort(jobPool.get());
+  }
+}
 
-    for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
+void WorldRenderer::recordDraws(
+  vk::CommandBuffer cmd_buf,
+  std::span<const glm::mat4x4> layer_tms,
+  vk::PipelineLayout pipeline_layout,
+  const etna::DescriptorSet& scene_set,
+  std::size_t begin,
+  std::size_t end)
+{
+  bindScene(cmd_buf, pipeline_layout, scene_set);
+
+  std::optional<std::uint32_t> pushedLayer;
+
+  SceneManager::IndexBinder indexBinder{*sceneMgr, cmd_buf};
+
+  const auto relems = sceneMgr->getRenderElements();
+  auto drawRelem = [&](std::uint32_t relem_idx, std::uint32_t first_instance, std::size_t count) {
+    const auto& relem = relems[relem_idx];
+    indexBinder.bind(relem.indexFormat);
+    cmd_buf.drawIndexed(
+      relem.indexCount,
+      static_cast<std::uint32_t>(count),
+      relem.indexOffset,
+      relem.vertexOffset,
+      first_instance);
+  };
+
+  // Draws were added in order of instances, which the sort keeps, so draws of a relem for
+  // consecutive instances end up next to each other and become a single instanced call.
+  // Index buffers are only rebound by indexBinder when the format changes.
+  const auto keys = drawList.getKeys();
+  const auto instances = drawList.getInstances();
+  for (std::size_t first = begin; first < end;)
+  {
+    std::size_t last = first + 1;
+    while (
+      last < end && keys[last] == keys[first] &&
+      instances[last] == instances[first] + (last - first))
+      ++last;
+
+    const auto key = DrawList::unpackKey(keys[first]);
+    if (pushedLayer != key.layer)
     {
-      const auto relemIdx = meshes[meshIdx].firstRelem + j;
-      const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      pushLayer(cmd_buf, pipeline_layout, layer_tms[key.layer], key.layer);
+      pushedLayer = key.layer;
     }
+
+    drawRelem(key.relem, instances[first], last - first);
+    first = last;
   }
 }
 
+void WorldRenderer::renderDrawListInParallel(
+  vk::CommandBuffer cmd_buf,
+  const ParallelRecorder::RenderingInfo& info,
+  const etna::GraphicsPipeline& pipeline,
+  std::span<const glm::mat4x4> layer_tms,
+  const etna::DescriptorSet& scene_set)
+{
+  ZoneScopedN("recordInParallel");
+
+  parallelRecorder->render(
+    cmd_buf,
+    info,
+    drawList.size(),
+    [&](vk::CommandBuffer secondary, std::size_t begin, std::size_t end) {
+      secondary.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
+      recordDraws(secondary, layer_tms, pipeline.getVkPipelineLayout(), scene_set, begin, end);
+    });
+}
+
 void WorldRenderer::renderWorld(
   vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view)
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
+  parallelRecorder->beginFrame();
+
   // draw scene to shadowmap
 
   {
     ETNA_PROFILE_GPU(cmd_buf, renderShadowMap);
 
-    etna::RenderTargetState renderTargets(
-      cmd_buf,
-      {{0, 0}, {2048, 2048}},
-      {},
-      {.image = shadowMap.get(), .view = shadowMap.getView({})});
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
-    renderScene(cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout());
+    const std::span<const glm::mat4x4> cascades{cascadeMatrices.data(), cascadeCount};
+
+    // NOTE: only the matrices used for culling are cropped, casters are drawn with cascades
+    if (culling == Culling::Gpu)
+      for (std::uint32_t i = 0; i < cascadeCount; ++i)
+        cullOnGpu(cmd_buf, casterMatrices[i], shadowDraws[i], CULLING_PASS_FRUSTUM);
+    else
+      buildDrawList({casterMatrices.data(), cascadeCount}, nullptr, false);
+
+    auto set = createSceneSet(cmd_buf, "simple_shadow", {});
+
+    // Draws of all cascades go into a single pass, each into the layer of its cascade
+    const ParallelRecorder::RenderingInfo shadowTarget{
+      .rect = {{0, 0}, {SHADOW_MAP_SIZE, SHADOW_MAP_SIZE}},
+      .colorAttachments = {},
+      .depthAttachment =
+        ParallelRecorder::Attachment{
+          .image = shadowMap.get(),
+          .view = shadowMap.getView({}),
+          .format = vk::Format::eD16Unorm,
+          .loadOp = vk::AttachmentLoadOp::eClear,
+          .clearValue = {.depthStencil = {.depth = 1.0f, .stencil = 0}},
+        },
+      .layerCount = SHADOW_CASCADE_COUNT,
+    };
+
+    if (recordsInParallel() && set.has_value())
+      renderDrawListInParallel(cmd_buf, shadowTarget, shadowPipeline, cascades, *set);
+    else
+      parallelRecorder->renderInline(cmd_buf, shadowTarget, [&](vk::CommandBuffer inline_buf) {
+        inline_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
+        renderScene(inline_buf, cascades, shadowPipeline.getVkPipelineLayout(), set, shadowDraws);
+      });
   }
 
   // draw final scene to screen
@@ -219,34 +885,89 @@ void WorldRenderer::renderWorld(
   {
     ETNA_PROFILE_GPU(cmd_buf, renderForward);
 
-    auto simpleMaterialInfo = etna::get_shader_program("simple_material");
-
-    auto set = etna::create_descriptor_set(
-      simpleMaterialInfo.getDescriptorLayoutId(0),
-      cmd_buf,
-      {etna::Binding{0, constants.genBinding()},
-       etna::Binding{
-         1, shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
-
-    etna::RenderTargetState renderTargets(
-      cmd_buf,
-      {{0, 0}, {resolution.x, resolution.y}},
-      {{.image = target_image, .view = target_image_view}},
-      {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, basicForwardPipeline.getVkPipeline());
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eGraphics,
-      basicForwardPipeline.getVkPipelineLayout(),
-      0,
-      {set.getVkSet()},
-      {});
-
-    renderScene(cmd_buf, worldViewProj, basicForwardPipeline.getVkPipelineLayout());
+    // NOTE: with occlusion culling the scene is drawn in two phases, what was visible
+    // in the previous frame goes first, then what turns out to be visible against its depth
+    const bool twoPhase = culling == Culling::Gpu && occlusionCulling;
+
+    if (culling != Culling::Gpu)
+      buildDrawList(
+        {&worldViewProj, 1},
+        usesSoftwareOcclusion() ? &occlusionBuffer : nullptr,
+        drawOrder == DrawOrder::FrontToBack);
+
+    auto drawForward = [&](vk::AttachmentLoadOp load_op) {
+      auto set = createSceneSet(
+        cmd_buf,
+        "simple_material",
+        {etna::Binding{0, constants.genBinding()},
+         etna::Binding{
+           1,
+           shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+
+      if (recordsInParallel() && set.has_value())
+      {
+        renderDrawListInParallel(
+          cmd_buf,
+          {
+            .rect = {{0, 0}, {resolution.x, resolution.y}},
+            .colorAttachments = {ParallelRecorder::Attachment{
+              .image = target_image,
+              .view = target_image_view,
+              .format = swapchainFormat,
+              .loadOp = load_op,
+              .clearValue = {.color = {std::array{0.0f, 0.0f, 0.0f, 1.0f}}},
+            }},
+            .depthAttachment =
+              ParallelRecorder::Attachment{
+                .image = mainViewDepth.get(),
+                .view = mainViewDepth.getView({}),
+                .format = vk::Format::eD32Sfloat,
+                .loadOp = load_op,
+                .clearValue = {.depthStencil = {.depth = 1.0f, .stencil = 0}},
+              },
+          },
+          basicForwardPipeline,
+          {&worldViewProj, 1},
+          *set);
+        return;
+      }
+
+      etna::RenderTargetState renderTargets(
+        cmd_buf,
+        {{0, 0}, {resolution.x, resolution.y}},
+        {{.image = target_image, .view = target_image_view, .loadOp = load_op}},
+        {.image = mainViewDepth.get(), .view = mainViewDepth.getView({}), .loadOp = load_op});
+
+      cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, basicForwardPipeline.getVkPipeline());
+      renderScene(
+        cmd_buf,
+        {&worldViewProj, 1},
+        basicForwardPipeline.getVkPipelineLayout(),
+        set,
+        {&mainDraws, 1});
+    };
+
+    if (culling == Culling::Gpu)
+      cullOnGpu(
+        cmd_buf, worldViewProj, mainDraws, twoPhase ? CULLING_PASS_EARLY : CULLING_PASS_FRUSTUM);
+    drawForward(vk::AttachmentLoadOp::eClear);
+
+    if (twoPhase)
+    {
+      buildDepthPyramid(cmd_buf);
+      cullOnGpu(cmd_buf, worldViewProj, mainDraws, CULLING_PASS_LATE);
+      drawForward(vk::AttachmentLoadOp::eLoad);
+    }
   }
 
   if (drawDebugFSQuad)
-    quadRenderer->render(cmd_buf, target_image, target_image_view, shadowMap, defaultSampler);
+    quadRenderer->render(
+      cmd_buf,
+      target_image,
+      target_image_view,
+      shadowMap,
+      defaultSampler,
+      {.baseMip = 0, .levelCount = 1, .baseLayer = debugCascade, .layerCount = 1});
 }
 
 void WorldRenderer::drawGui()
@@ -267,6 +988,30 @@ void WorldRenderer::drawGui()
     1000.0f / ImGui::GetIO().Framerate,
     ImGui::GetIO().Framerate);
 
+  if (sceneMgr->isLoading())
+    ImGui::Text("Loading the scene...");
+
+  int cullingMode = static_cast<int>(culling);
+  ImGui::Combo("Frustum culling", &cullingMode, "Disabled\0Relem boxes\0Instance BVH\0GPU\0");
+  culling = static_cast<Culling>(cullingMode);
+  ImGui::Checkbox("Occlusion culling (GPU only)", &occlusionCulling);
+  ImGui::Checkbox("Cull shadow casters outside of the view", &cullShadowCasters);
+  ImGui::SliderInt("Shadow cascades", &lightProps.cascadeCount, 2, int(SHADOW_CASCADE_COUNT));
+  ImGui::SliderFloat("Shadow distance", &lightProps.shadowDistance, 5.0f, 200.0f);
+  ImGui::SliderFloat("Cascade split blend", &lightProps.splitBlend, 0.0f, 1.0f);
+  int shownCascade = static_cast<int>(debugCascade);
+  ImGui::SliderInt("Cascade shown with 'Q'", &shownCascade, 0, int(SHADOW_CASCADE_COUNT) - 1);
+  debugCascade = static_cast<std::uint32_t>(shownCascade);
+  ImGui::Checkbox("Software occlusion culling (CPU only)", &softwareOcclusion);
+  if (usesSoftwareOcclusion())
+    ImGui::Text("Occluder triangles: %zu", occlusionBuffer.getTriangleCount());
+
+  ImGui::Checkbox("Record draws on worker threads (CPU only)", &parallelRecording);
+
+  int drawOrderMode = static_cast<int>(drawOrder);
+  ImGui::Combo("Draw order (CPU only)", &drawOrderMode, "By relem\0Front to back\0");
+  drawOrder = static_cast<DrawOrder>(drawOrderMode);
+
   ImGui::NewLine();
 
   ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Press 'B' to recompile and reload shaders");
@@ -1,13 +1,21 @@
 #pragma once
 
+#include <array>
+#include <optional>
+#include <span>
+
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/Buffer.hpp>
 #include <etna/GraphicsPipeline.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/DescriptorSet.hpp>
 #include <glm/glm.hpp>
 
 #include "shaders/UniformParams.h"
 #include "scene/SceneManager.hpp"
+#include "render_utils/DrawList.hpp"
+#include "render_utils/ParallelRecorder.hpp"
 #include "render_utils/QuadRenderer.hpp"
 #include "wsi/Keyboard.hpp"
 
@@ -36,14 +44,89 @@ public:
     vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
 
 private:
+  // Draw commands of a view written by culling.comp, relems with 32-bit and 16-bit indices
+  // occupy separate regions of the same size, each with its own count
+  struct GpuDrawList
+  {
+    etna::Buffer commands;
+    etna::Buffer counts;
+  };
+
+  // Draw lists have to hold every relem instance of the current scene
+  void updateGpuDrawLists();
+  // Must be recorded outside of rendering, the draw list is ready for renderScene afterwards.
+  // Pass is one of CULLING_PASS_*, only the main view supports occlusion passes.
+  void cullOnGpu(
+    vk::CommandBuffer cmd_buf,
+    const glm::mat4x4& glob_tm,
+    const GpuDrawList& draws,
+    std::uint32_t pass);
+  // Reduces mainViewDepth into depthPyramid for occlusion tests
+  void buildDepthPyramid(vk::CommandBuffer cmd_buf);
+
+  // Software occlusion only complements culling on the CPU
+  bool usesSoftwareOcclusion() const
+  {
+    return softwareOcclusion &&
+      (culling == Culling::RelemBoxes || culling == Culling::InstanceBvh);
+  }
+  // Rasterizes the largest visible instances of the main view into occlusionBuffer
+  void updateOcclusionBuffer();
+  // Splits the view between cascades and fits the light matrices to their slices
+  void updateCascades(const FramePacket& packet);
+
+  // Set 0 of a pass holds its own bindings followed by the instance buffer.
+  // Nothing to bind before the scene is loaded, so there is no set then.
+  std::optional<etna::DescriptorSet> createSceneSet(
+    vk::CommandBuffer cmd_buf, const char* program_name, std::vector<etna::Binding> bindings);
+  // Everything but the pipeline and index buffers, which every command buffer has to bind anew
+  void bindScene(
+    vk::CommandBuffer cmd_buf,
+    vk::PipelineLayout pipeline_layout,
+    const etna::DescriptorSet& scene_set);
+  // Following draws go into the layer of a layered target, seen through glob_tm
+  void pushLayer(
+    vk::CommandBuffer cmd_buf,
+    vk::PipelineLayout pipeline_layout,
+    const glm::mat4x4& glob_tm,
+    std::uint32_t layer);
+  // Culls the scene on the CPU and fills drawList with sorted draws of the pass,
+  // every layer of the target is culled with its own matrix
+  void buildDrawList(
+    std::span<const glm::mat4x4> cull_tms, const OcclusionBuffer* occlusion, bool front_to_back);
+  // Records draws [begin, end) of drawList, safe to call from several threads at once
+  void recordDraws(
+    vk::CommandBuffer cmd_buf,
+    std::span<const glm::mat4x4> layer_tms,
+    vk::PipelineLayout pipeline_layout,
+    const etna::DescriptorSet& scene_set,
+    std::size_t begin,
+    std::size_t end);
+  // Splits drawList between secondary command buffers recorded on worker threads
+  void renderDrawListInParallel(
+    vk::CommandBuffer cmd_buf,
+    const ParallelRecorder::RenderingInfo& info,
+    const etna::GraphicsPipeline& pipeline,
+    std::span<const glm::mat4x4> layer_tms,
+    const etna::DescriptorSet& scene_set);
+  bool recordsInParallel() const { return parallelRecording && culling != Culling::Gpu; }
   void renderScene(
-    vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
+    vk::CommandBuffer cmd_buf,
+    std::span<const glm::mat4x4> layer_tms,
+    vk::PipelineLayout pipeline_layout,
+    const std::optional<etna::DescriptorSet>& scene_set,
+    std::span<const GpuDrawList> gpu_draws);
 
 
 private:
   std::unique_ptr<SceneManager> sceneMgr;
 
   etna::Image mainViewDepth;
+  // Level 0 is half of the resolution rounded up to a power of two, so that every texel
+  // of every level covers exactly 2x2 texels of the level below
+  etna::Image depthPyramid;
+  glm::uvec2 depthPyramidSize;
+  std::uint32_t depthPyramidLevels = 0;
   etna::Image shadowMap;
   etna::Sampler defaultSampler;
   etna::Buffer constants;
@@ -51,32 +134,110 @@ private:
   struct PushConstants
   {
     glm::mat4x4 projView;
-    glm::mat4x4 model;
-  } pushConst2M;
+    std::uint32_t layer;
+  };
+
+  // Relem boxes are all tested one by one, which is precise, while the BVH rejects and accepts
+  // whole groups of instances at once, which is faster on big scenes. On the GPU relem boxes
+  // are tested by a compute shader, so the CPU cost doesn't depend on the scene at all.
+  enum class Culling
+  {
+    Disabled,
+    RelemBoxes,
+    InstanceBvh,
+    Gpu,
+  };
+  Culling culling = Culling::RelemBoxes;
+
+  // Indices of relem instances or instances that passed culling, reused by every pass
+  std::vector<std::uint32_t> visibleRelemInstances;
+  std::vector<std::uint32_t> visibleInstances;
+
+  // Visible draws of a pass are sorted before being recorded. Grouping them by relem
+  // gives the most instanced calls, while going front to back lets the depth test
+  // reject more fragments. The shadow pass always groups by relem.
+  enum class DrawOrder
+  {
+    ByRelem,
+    FrontToBack,
+  };
+  DrawOrder drawOrder = DrawOrder::FrontToBack;
+  DrawList drawList;
+
+  // Worker threads for CPU culling, sorting and recording draws
+  std::unique_ptr<ThreadPool> jobPool;
+  // Draws of CPU culled passes can be recorded into secondary command buffers on jobPool,
+  // which pays off once there are tens of thousands of them
+  std::unique_ptr<ParallelRecorder> parallelRecorder;
+  bool parallelRecording = false;
+
+  std::array<GpuDrawList, SHADOW_CASCADE_COUNT> shadowDraws;
+  GpuDrawList mainDraws;
+  std::size_t gpuDrawCapacity = 0;
+  // Lists are rebuilt when another scene is swapped in
+  std::uint64_t gpuDrawSceneVersion = 0;
+  // Results of the late pass for every relem instance of the main view, zeroed on first use
+  etna::Buffer mainVisibility;
+  bool mainVisibilityValid = false;
+
+  // Lists replaced on a scene swap may still be used by frames in flight
+  struct RetiredDrawLists
+  {
+    std::array<GpuDrawList, SHADOW_CASCADE_COUNT> shadowDraws;
+    GpuDrawList mainDraws;
+    etna::Buffer mainVisibility;
+    std::size_t framesLeft;
+  };
+  std::vector<RetiredDrawLists> retiredDrawLists;
+  // Draw what was visible in the previous frame, then test the rest against its depth
+  bool occlusionCulling = true;
+
+  // Instances that passed CPU culling are also tested against occluders rasterized on the CPU,
+  // which is cheaper than occlusion culling on weak GPUs
+  bool softwareOcclusion = false;
+  OcclusionBuffer occlusionBuffer;
+  // Screen size and index of instances that may become occluders, largest first
+  std::vector<std::pair<float, std::uint32_t>> occluderCandidates;
 
   glm::mat4x4 worldViewProj;
-  glm::mat4x4 lightMatrix;
+  // Cascades of the shadow map, each fit to its slice of the view and moved by whole texels.
+  // The ones for culling are cropped to where they overlap their slice and extended
+  // toward the light, the shadow pass only needs casters inside of them.
+  std::array<glm::mat4x4, SHADOW_CASCADE_COUNT> cascadeMatrices;
+  std::array<glm::mat4x4, SHADOW_CASCADE_COUNT> casterMatrices;
+  std::uint32_t cascadeCount = 1;
+  bool cullShadowCasters = true;
+  // Layer of the shadow map shown by the debug quad
+  std::uint32_t debugCascade = 0;
   glm::vec3 lightPos;
 
   struct ShadowMapCam
   {
-    float radius = 10;
     float lightTargetDist = 24;
     bool usePerspectiveM = false;
+    int cascadeCount = 4;
+    // Shadows end here even if the camera sees further
+    float shadowDistance = 60;
+    // 0 splits the view into cascades uniformly, 1 logarithmically
+    float splitBlend = 0.75f;
   } lightProps;
 
   UniformParams uniformParams{
-    .lightMatrix = {},
+    .cascadeMatrices = {},
     .lightPos = {},
     .time = {},
     .baseColor = {0.9f, 0.92f, 1.0f},
+    .cascadeCount = {},
   };
 
   etna::GraphicsPipeline basicForwardPipeline{};
   etna::GraphicsPipeline shadowPipeline{};
+  etna::ComputePipeline cullingPipeline{};
+  etna::ComputePipeline depthReducePipeline{};
 
   std::unique_ptr<QuadRenderer> quadRenderer;
   bool drawDebugFSQuad = false;
 
   glm::uvec2 resolution;
+  vk::Format swapchainFormat = vk::Format::eUndefined;
 };
@@ -0,0 +1,38 @@
+#ifndef CULLING_PARAMS_H_INCLUDED
+#define CULLING_PARAMS_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Frustum culling only, visibility is neither read nor written
+const shader_uint CULLING_PASS_FRUSTUM = 0u;
+// Draws what was visible after the previous frame
+const shader_uint CULLING_PASS_EARLY = 1u;
+// Tests against the depth pyramid built from the early pass, records visibility
+// for the next frame and draws what became visible
+const shader_uint CULLING_PASS_LATE = 2u;
+
+// Push constants of culling.comp
+struct CullingParams
+{
+  // Frustum planes are extracted from it, and boxes are projected with it for occlusion tests
+  shader_mat4 viewProj;
+  shader_uint relemInstanceCount;
+  // Commands are written to a region of this size per index format, so that each
+  // can be drawn with a single indirect call using the matching index buffer
+  shader_uint drawRegionSize;
+  shader_uint pass;
+  shader_uint depthPyramidLevels;
+  // Resolution of the depth buffer the pyramid was built from
+  shader_uvec2 depthSize;
+};
+
+// Push constants of depth_reduce.comp
+struct DepthReduceParams
+{
+  shader_uvec2 srcSize;
+  shader_uvec2 dstSize;
+};
+
+
+#endif // CULLING_PARAMS_H_INCLUDED
@@ -4,12 +4,17 @@
 #include "cpp_glsl_compat.h"
 
 
+// Layers of the shadow map, a perspective light only uses the first one
+const shader_uint SHADOW_CASCADE_COUNT = 4u;
+
 struct UniformParams
 {
-  shader_mat4 lightMatrix;
+  // Cascades go from the closest to the camera to the furthest, each covering more of the view
+  shader_mat4 cascadeMatrices[SHADOW_CASCADE_COUNT];
   shader_vec3 lightPos;
   shader_float time;
   shader_vec3 baseColor;
+  shader_uint cascadeCount;
 };
 
 
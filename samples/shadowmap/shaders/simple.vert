@@ -1,8 +1,10 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : require
+#extension GL_ARB_shader_viewport_layer_array : require
 
 #include "unpack_attributes.glsl"
+#include "InstanceData.h"
 
 
 layout(location = 0) in vec4 vPosNorm;
@@ -11,9 +13,15 @@ layout(location = 1) in vec4 vTexCoordAndTang;
 layout(push_constant) uniform params_t
 {
   mat4 mProjView;
-  mat4 mModel;
+  // Layer of a layered target to draw into, all cascades of a shadow map are drawn at once
+  uint layer;
 } params;
 
+layout(binding = 2, set = 0) readonly buffer Instances
+{
+  InstanceData instances[];
+};
+
 
 layout (location = 0 ) out VS_OUT
 {
@@ -29,10 +37,13 @@ void main(void)
   const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
   const vec4 wTang = vec4(decode_normal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
 
-  vOut.wPos = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
-  vOut.wNorm = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
-  vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
+  const InstanceData instance = instances[gl_InstanceIndex];
+
+  vOut.wPos = (instance.model * vec4(vPosNorm.xyz, 1.0f)).xyz;
+  vOut.wNorm = normalize(mat3(instance.normal) * wNorm.xyz);
+  vOut.wTangent = normalize(mat3(instance.normal) * wTang.xyz);
   vOut.texCoord = vTexCoordAndTang.xy;
 
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
+  gl_Layer      = int(params.layer);
 }
@@ -20,20 +20,30 @@ layout(binding = 0, set = 0) uniform AppData
   UniformParams params;
 };
 
-layout(binding = 1) uniform sampler2D shadowMap;
+layout(binding = 1) uniform sampler2DArray shadowMap;
 
 void main()
 {
-  const vec4 posLightClipSpace = params.lightMatrix*vec4(surf.wPos, 1.0f);
-
-  // for orto matrix, we don't need perspective division, you can remove it if you want; this is general case;
-  const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
-
-  // just shift coords from [-1,1] to [0,1]
-  const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
-
-  const bool  outOfView = (shadowTexCoord.x < 0.0001f || shadowTexCoord.x > 0.9999f || shadowTexCoord.y < 0.0091f || shadowTexCoord.y > 0.9999f);
-  const float shadow    = ((posLightSpaceNDC.z < textureLod(shadowMap, shadowTexCoord, 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;
+  // Cascades are nested closest first, so the first one that has the point is the sharpest
+  float shadow = 1.0f;
+  for (uint cascade = 0u; cascade < params.cascadeCount; ++cascade)
+  {
+    const vec4 posLightClipSpace = params.cascadeMatrices[cascade]*vec4(surf.wPos, 1.0f);
+
+    // for orto matrix, we don't need perspective division, you can remove it if you want; this is general case;
+    const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
+
+    // just shift coords from [-1,1] to [0,1]
+    const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
+
+    const bool outOfView = (shadowTexCoord.x < 0.0001f || shadowTexCoord.x > 0.9999f || shadowTexCoord.y < 0.0091f || shadowTexCoord.y > 0.9999f || posLightSpaceNDC.z > 1.0f);
+    if (outOfView)
+      continue;
+
+    const float depth = textureLod(shadowMap, vec3(shadowTexCoord, float(cascade)), 0).x;
+    shadow = posLightSpaceNDC.z < depth + 0.001f ? 1.0f : 0.0f;
+    break;
+  }
 
   const vec4 dark_violet = vec4(0.59f, 0.0f, 0.82f, 1.0f);
   const vec4 chartreuse  = vec4(0.5f, 1.0f, 0.0f, 1.0f);
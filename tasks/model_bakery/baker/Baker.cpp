@@ -0,0 +1,870 @@
+#include "Baker.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+#include <tiny_gltf.h>
+
+#include "scene/BakedScene.hpp"
+#include "scene/Bounds.hpp"
+#include "scene/GltfInstances.hpp"
+#include "scene/ShortIndices.hpp"
+#include "scene/VertexWeld.hpp"
+
+#include "MeshOptimization.hpp"
+#include "Simplifier.hpp"
+
+
+namespace
+{
+
+constexpr const char* QUANTIZATION_EXTENSION = "KHR_mesh_quantization";
+
+bool skip_image_loading(
+  tinygltf::Image*,
+  const int,
+  std::string*,
+  std::string*,
+  int,
+  int,
+  const unsigned char*,
+  int,
+  void*)
+{
+  // NOTE: the baker doesn't touch images. Decoding them would not only be a waste of time,
+  // but would also make tinygltf re-encode them when writing the baked model.
+  return true;
+}
+
+std::optional<tinygltf::Model> load_model(const std::filesystem::path& path)
+{
+  tinygltf::TinyGLTF loader;
+  loader.SetImageLoader(skip_image_loading, nullptr);
+
+  tinygltf::Model model;
+
+  std::string error;
+  std::string warning;
+  bool success = false;
+
+  auto ext = path.extension();
+  if (ext == ".gltf")
+    success = loader.LoadASCIIFromFile(&model, &error, &warning, path.string());
+  else if (ext == ".glb")
+    success = loader.LoadBinaryFromFile(&model, &error, &warning, path.string());
+  else
+  {
+    spdlog::error("glTF: Unknown glTF file extension: '{}'. Expected .gltf or .glb.", ext);
+    return std::nullopt;
+  }
+
+  if (!success)
+  {
+    spdlog::error("glTF: Failed to load model '{}'!", path);
+    if (!error.empty())
+      spdlog::error("glTF: {}", error);
+    return std::nullopt;
+  }
+
+  if (!warning.empty())
+    spdlog::warn("glTF: {}", warning);
+
+  return model;
+}
+
+template <class T>
+T load_unaligned(const unsigned char* src)
+{
+  T result;
+  std::memcpy(&result, src, sizeof(T));
+  return result;
+}
+
+float read_component(const unsigned char* src, int component_type, bool normalized)
+{
+  // NOTE: see "Animation" and "KHR_mesh_quantization" sections of the
+  // spec for the normalized integer to float conversion rules.
+  switch (component_type)
+  {
+  case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    return load_unaligned<float>(src);
+  case TINYGLTF_COMPONENT_TYPE_BYTE: {
+    const float value = load_unaligned<std::int8_t>(src);
+    return normalized ? std::max(value / 127.0f, -1.0f) : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+    const float value = load_unaligned<std::uint8_t>(src);
+    return normalized ? value / 255.0f : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_SHORT: {
+    const float value = load_unaligned<std::int16_t>(src);
+    return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+    const float value = load_unaligned<std::uint16_t>(src);
+    return normalized ? value / 65535.0f : value;
+  }
+  default:
+    return 0.0f;
+  }
+}
+
+// Typed view of a glTF accessor, unlike the runtime decoder in SceneManager
+// this one accepts any component type, as baking speed is not that important.
+class AccessorReader
+{
+public:
+  AccessorReader(const tinygltf::Model& model, const tinygltf::Accessor& accessor)
+    : componentType{accessor.componentType}
+    , componentCount{std::min(tinygltf::GetNumComponentsInType(accessor.type), 4)}
+    , componentSize{tinygltf::GetComponentSizeInBytes(accessor.componentType)}
+    , normalized{accessor.normalized}
+    , count{accessor.count}
+  {
+    // NOTE: accessors without a buffer view are all zeros by spec
+    if (accessor.bufferView < 0)
+      return;
+
+    const auto& view = model.bufferViews[accessor.bufferView];
+    const auto& buffer = model.buffers[view.buffer];
+
+    stride = view.byteStride != 0
+      ? view.byteStride
+      : static_cast<std::size_t>(componentSize) * static_cast<std::size_t>(componentCount);
+
+    const std::size_t begin = view.byteOffset + accessor.byteOffset;
+    const std::size_t elementSize =
+      static_cast<std::size_t>(componentSize) * static_cast<std::size_t>(componentCount);
+    if (
+      componentSize <= 0 || count == 0 ||
+      begin + (count - 1) * stride + elementSize > buffer.data.size())
+      return;
+
+    data = buffer.data.data() + begin;
+  }
+
+  bool isValid() const { return data != nullptr; }
+
+  std::size_t size() const { return count; }
+
+  glm::vec4 readFloats(std::size_t idx) const
+  {
+    glm::vec4 result{0};
+    if (data == nullptr)
+      return result;
+
+    const unsigned char* element = data + idx * stride;
+    for (int i = 0; i < componentCount; ++i)
+      result[i] = read_component(element + i * componentSize, componentType, normalized);
+    return result;
+  }
+
+  std::uint32_t readIndex(std::size_t idx) const
+  {
+    if (data == nullptr)
+      return 0;
+
+    const unsigned char* element = data + idx * stride;
+    switch (componentType)
+    {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      return load_unaligned<std::uint8_t>(element);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      return load_unaligned<std::uint16_t>(element);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+      return load_unaligned<std::uint32_t>(element);
+    default:
+      return 0;
+    }
+  }
+
+private:
+  const unsigned char* data = nullptr;
+  std::size_t stride = 0;
+  int componentType;
+  int componentCount;
+  int componentSize;
+  bool normalized;
+  std::size_t count;
+};
+
+std::int8_t quantize_snorm8(float value)
+{
+  if (std::isnan(value))
+    return 0;
+  return static_cast<std::int8_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+}
+
+std::array<std::int8_t, 4> quantize_direction(glm::vec3 dir, std::int8_t w)
+{
+  const float length = glm::length(dir);
+  if (length > 0.0f)
+    dir /= length;
+  return {quantize_snorm8(dir.x), quantize_snorm8(dir.y), quantize_snorm8(dir.z), w};
+}
+
+// Everything needed to describe a baked primitive in the output glTF
+struct PrimitiveInfo
+{
+  int material;
+  bool hasNormals;
+  bool hasTangents;
+  bool hasTexcoord;
+  glm::vec3 positionMin;
+  glm::vec3 positionMax;
+  std::size_t vertexCount;
+};
+
+struct BakedMeshes
+{
+  std::vector<baked::Vertex> vertices;
+  std::vector<std::uint32_t> indices;
+  // Indices of relems that don't need 32 bits, see narrow_indices
+  std::vector<std::uint16_t> shortIndices;
+  std::vector<RenderElement> relems;
+  std::vector<Mesh> meshes;
+  std::vector<Meshlet> meshlets;
+  // One per relem
+  std::vector<PrimitiveInfo> primitives;
+};
+
+std::optional<BakedMeshes> bake_meshes(const tinygltf::Model& model)
+{
+  BakedMeshes result;
+  result.meshes.reserve(model.meshes.size());
+
+  for (const auto& mesh : model.meshes)
+  {
+    result.meshes.push_back(Mesh{
+      .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
+      .relemCount = 0,
+      .lodCount = 1,
+      .lodErrors = {},
+      .bounds = {},
+    });
+
+    for (const auto& prim : mesh.primitives)
+    {
+      if (prim.mode != TINYGLTF_MODE_TRIANGLES && prim.mode != -1)
+      {
+        spdlog::warn(
+          "Encountered a non-triangles primitive, these are not supported, skipping it!");
+        continue;
+      }
+
+      const auto positionIt = prim.attributes.find("POSITION");
+      if (positionIt == prim.attributes.end())
+      {
+        spdlog::warn("Encountered a primitive without positions, skipping it!");
+        continue;
+      }
+
+      const auto normalIt = prim.attributes.find("NORMAL");
+      const auto tangentIt = prim.attributes.find("TANGENT");
+      const auto texcoordIt = prim.attributes.find("TEXCOORD_0");
+
+      const bool hasNormals = normalIt != prim.attributes.end();
+      const bool hasTangents = tangentIt != prim.attributes.end();
+      const bool hasTexcoord = texcoordIt != prim.attributes.end();
+
+      const AccessorReader positions{model, model.accessors[positionIt->second]};
+      if (!positions.isValid())
+      {
+        spdlog::error("Primitive positions are out of buffer bounds!");
+        return std::nullopt;
+      }
+
+      const std::size_t vertexCount = positions.size();
+
+      // NOTE: attributes are read for every position, so shorter ones would be read past their end
+      auto hasVertexCount = [&](const AccessorReader& attribute, const char* name) {
+        if (attribute.size() == vertexCount)
+          return true;
+        spdlog::error(
+          "Primitive has {} {} for {} positions!", attribute.size(), name, vertexCount);
+        return false;
+      };
+
+      const std::size_t firstVertex = result.vertices.size();
+      const std::size_t firstIndex = result.indices.size();
+
+      PrimitiveInfo info{
+        .material = prim.material,
+        .hasNormals = hasNormals,
+        .hasTangents = hasTangents,
+        .hasTexcoord = hasTexcoord,
+        .positionMin = glm::vec3{std::numeric_limits<float>::max()},
+        .positionMax = glm::vec3{std::numeric_limits<float>::lowest()},
+        .vertexCount = vertexCount,
+      };
+
+      result.vertices.resize(firstVertex + vertexCount, baked::Vertex{});
+      const std::span vertices{result.vertices.data() + firstVertex, vertexCount};
+
+      for (std::size_t i = 0; i < vertexCount; ++i)
+      {
+        vertices[i].position = glm::vec3(positions.readFloats(i));
+        info.positionMin = glm::min(info.positionMin, vertices[i].position);
+        info.positionMax = glm::max(info.positionMax, vertices[i].position);
+      }
+
+      if (hasNormals)
+      {
+        const AccessorReader normals{model, model.accessors[normalIt->second]};
+        if (!hasVertexCount(normals, "normals"))
+          return std::nullopt;
+        for (std::size_t i = 0; i < vertexCount; ++i)
+          vertices[i].normal = quantize_direction(glm::vec3(normals.readFloats(i)), 0);
+      }
+
+      if (hasTangents)
+      {
+        // NOTE: glTF requires the 4th component to be the handedness of the tangent space
+        // basis, so it is preserved, even though our renderer always uses the same one.
+        const AccessorReader tangents{model, model.accessors[tangentIt->second]};
+        if (!hasVertexCount(tangents, "tangents"))
+          return std::nullopt;
+        for (std::size_t i = 0; i < vertexCount; ++i)
+        {
+          const glm::vec4 tangent = tangents.readFloats(i);
+          vertices[i].tangent =
+            quantize_direction(glm::vec3(tangent), tangent.w < 0.0f ? -127 : 127);
+        }
+      }
+
+      if (hasTexcoord)
+      {
+        const AccessorReader texcoords{model, model.accessors[texcoordIt->second]};
+        if (!hasVertexCount(texcoords, "texcoords"))
+          return std::nullopt;
+        for (std::size_t i = 0; i < vertexCount; ++i)
+          vertices[i].texCoord = glm::vec2(texcoords.readFloats(i));
+      }
+
+      // NOTE: non-indexed primitives are simply given trivial indices,
+      // so that the renderer doesn't have to care about them.
+      if (prim.indices >= 0)
+      {
+        const AccessorReader indices{model, model.accessors[prim.indices]};
+        if (!indices.isValid())
+        {
+          spdlog::error("Primitive indices are out of buffer bounds!");
+          return std::nullopt;
+        }
+
+        result.indices.reserve(firstIndex + indices.size());
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+          const std::uint32_t index = indices.readIndex(i);
+          if (index >= vertexCount)
+          {
+            spdlog::error("Primitive index {} is out of range!", index);
+            return std::nullopt;
+          }
+          result.indices.push_back(index);
+        }
+      }
+      else
+      {
+        result.indices.reserve(firstIndex + vertexCount);
+        for (std::size_t i = 0; i < vertexCount; ++i)
+          result.indices.push_back(static_cast<std::uint32_t>(i));
+      }
+
+      result.relems.push_back(RenderElement{
+        .vertexOffset = static_cast<std::uint32_t>(firstVertex),
+        .indexOffset = static_cast<std::uint32_t>(firstIndex),
+        .indexCount = static_cast<std::uint32_t>(result.indices.size() - firstIndex),
+        .firstMeshlet = 0,
+        .meshletCount = 0,
+        .lods = {},
+        .indexFormat = IndexFormat::U32,
+        .bounds = {},
+      });
+      result.primitives.push_back(info);
+      ++result.meshes.back().relemCount;
+    }
+  }
+
+  return result;
+}
+
+// glTF requires every mesh to have primitives, so meshes without supported ones are dropped
+// along with the references to them
+void drop_empty_meshes(tinygltf::Model& model, BakedMeshes& meshes)
+{
+  std::vector<int> remap(model.meshes.size(), -1);
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < model.meshes.size(); ++i)
+  {
+    if (meshes.meshes[i].relemCount == 0)
+    {
+      spdlog::warn("Mesh '{}' has no supported primitives, dropping it", model.meshes[i].name);
+      continue;
+    }
+
+    remap[i] = static_cast<int>(kept);
+    if (kept != i)
+    {
+      model.meshes[kept] = std::move(model.meshes[i]);
+      meshes.meshes[kept] = meshes.meshes[i];
+    }
+    ++kept;
+  }
+
+  model.meshes.resize(kept);
+  meshes.meshes.resize(kept);
+
+  for (auto& node : model.nodes)
+    if (node.mesh >= 0)
+      node.mesh = remap[node.mesh];
+}
+
+// NOTE: quantized normals and tangents make even more vertices identical,
+// so welding happens on the final vertex format.
+void weld_meshes(BakedMeshes& meshes, const std::filesystem::path& src)
+{
+  std::size_t weldedVertices = 0;
+  for (std::size_t i = 0; i < meshes.relems.size(); ++i)
+  {
+    auto& relem = meshes.relems[i];
+    auto& vertexCount = meshes.primitives[i].vertexCount;
+    vertexCount = weld_vertices(
+      std::span{meshes.indices}.subspan(relem.indexOffset, relem.indexCount),
+      reinterpret_cast<std::byte*>(meshes.vertices.data() + relem.vertexOffset),
+      sizeof(baked::Vertex),
+      vertexCount);
+
+    std::copy_n(
+      meshes.vertices.begin() + relem.vertexOffset,
+      vertexCount,
+      meshes.vertices.begin() + weldedVertices);
+    relem.vertexOffset = static_cast<std::uint32_t>(weldedVertices);
+    weldedVertices += vertexCount;
+  }
+
+  spdlog::info(
+    "'{}': welded {} vertices into {}, saved {} bytes",
+    src,
+    meshes.vertices.size(),
+    weldedVertices,
+    (meshes.vertices.size() - weldedVertices) * sizeof(baked::Vertex));
+  meshes.vertices.resize(weldedVertices);
+}
+
+void optimize_meshes(BakedMeshes& meshes, const std::filesystem::path& src)
+{
+  for (std::size_t i = 0; i < meshes.relems.size(); ++i)
+  {
+    const auto& relem = meshes.relems[i];
+    const std::span vertices{
+      meshes.vertices.data() + relem.vertexOffset, meshes.primitives[i].vertexCount};
+    const std::span indices{meshes.indices.data() + relem.indexOffset, relem.indexCount};
+
+    const auto before = analyze_vertex_cache(indices, vertices.size());
+
+    optimize_vertex_cache(indices, vertices);
+    optimize_vertex_fetch(indices, vertices);
+
+    const auto after = analyze_vertex_cache(indices, vertices.size());
+
+    spdlog::info(
+      "'{}' relem {}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+      src,
+      i,
+      before.acmr,
+      after.acmr,
+      before.atvr,
+      after.atvr);
+  }
+}
+
+// NOTE: must run after the index order is final, as meshlets are ranges of the index buffer
+void build_relem_meshlets(BakedMeshes& meshes)
+{
+  for (std::size_t i = 0; i < meshes.relems.size(); ++i)
+  {
+    auto& relem = meshes.relems[i];
+    const auto relemMeshlets = build_meshlets(
+      std::span{meshes.indices}.subspan(relem.indexOffset, relem.indexCount),
+      reinterpret_cast<const std::byte*>(meshes.vertices.data() + relem.vertexOffset),
+      sizeof(baked::Vertex),
+      meshes.primitives[i].vertexCount);
+
+    relem.firstMeshlet = static_cast<std::uint32_t>(meshes.meshlets.size());
+    relem.meshletCount = static_cast<std::uint32_t>(relemMeshlets.size());
+    meshes.meshlets.insert(meshes.meshlets.end(), relemMeshlets.begin(), relemMeshlets.end());
+  }
+}
+
+// NOTE: welding and optimization don't move vertices in space, so bounds can be computed
+// at any point after decoding. Coarser LODs reference a subset of the same vertices.
+void compute_relem_bounds(BakedMeshes& meshes)
+{
+  for (auto& relem : meshes.relems)
+    relem.bounds = compute_bounds(
+      std::span{meshes.indices}.subspan(relem.indexOffset, relem.indexCount),
+      reinterpret_cast<const std::byte*>(meshes.vertices.data() + relem.vertexOffset),
+      sizeof(baked::Vertex));
+
+  for (auto& mesh : meshes.meshes)
+  {
+    std::vector<Bounds> relemBounds;
+    relemBounds.reserve(mesh.relemCount);
+    for (const auto& relem : std::span{meshes.relems}.subspan(mesh.firstRelem, mesh.relemCount))
+      relemBounds.push_back(relem.bounds);
+    mesh.bounds = merge_bounds(relemBounds);
+  }
+}
+
+// NOTE: LOD indices are appended after all of the original ones, which keeps the
+// ranges referenced by the json and by meshlets intact.
+void build_lods(BakedMeshes& meshes)
+{
+  for (auto& mesh : meshes.meshes)
+  {
+    const auto relems = std::span{meshes.relems}.subspan(mesh.firstRelem, mesh.relemCount);
+
+    std::size_t previousTriangles = 0;
+    for (const auto& relem : relems)
+      previousTriangles += relem.indexCount / 3;
+
+    for (std::size_t lod = 1; lod < MAX_LODS; ++lod)
+    {
+      // Every level halves the triangle count of the original relems
+      std::vector<SimplifiedIndices> simplified;
+      simplified.reserve(relems.size());
+      std::size_t triangles = 0;
+      float error = mesh.lodErrors[lod - 1];
+      for (std::size_t i = 0; i < relems.size(); ++i)
+      {
+        const auto& relem = relems[i];
+        const std::span vertices{
+          meshes.vertices.data() + relem.vertexOffset,
+          meshes.primitives[mesh.firstRelem + i].vertexCount};
+
+        auto& result = simplified.emplace_back(simplify(
+          std::span{meshes.indices}.subspan(relem.indexOffset, relem.indexCount),
+          vertices,
+          (relem.indexCount / 3) >> lod));
+
+        optimize_vertex_cache(result.indices, vertices);
+        triangles += result.indices.size() / 3;
+        error = std::max(error, result.error);
+      }
+
+      // A level that is barely simpler than the previous one is not worth switching to
+      if (triangles * 10 > previousTriangles * 9)
+        break;
+
+      for (std::size_t i = 0; i < relems.size(); ++i)
+      {
+        relems[i].lods[lod - 1] = IndexRange{
+          .offset = static_cast<std::uint32_t>(meshes.indices.size()),
+          .count = static_cast<std::uint32_t>(simplified[i].indices.size()),
+        };
+        meshes.indices.insert(
+          meshes.indices.end(), simplified[i].indices.begin(), simplified[i].indices.end());
+      }
+
+      mesh.lodErrors[lod] = error;
+      mesh.lodCount = static_cast<std::uint32_t>(lod + 1);
+      previousTriangles = triangles;
+    }
+
+    // Levels that could not be generated fall back to the coarsest one
+    for (auto& relem : relems)
+      for (std::size_t lod = mesh.lodCount; lod < MAX_LODS; ++lod)
+        relem.lods[lod - 1] = get_lod_indices(relem, mesh.lodCount - 1);
+  }
+}
+
+void align_buffer(std::vector<unsigned char>& buffer)
+{
+  const std::size_t misalignment = buffer.size() % baked::SECTION_ALIGNMENT;
+  if (misalignment != 0)
+    buffer.resize(buffer.size() + baked::SECTION_ALIGNMENT - misalignment, 0);
+}
+
+template <class T>
+void append_section(
+  std::vector<unsigned char>& buffer,
+  baked::Header& header,
+  baked::Section section,
+  const std::vector<T>& data)
+{
+  align_buffer(buffer);
+
+  header.sections[static_cast<std::size_t>(section)] = baked::SectionRange{
+    .offset = buffer.size(),
+    .size = data.size() * sizeof(T),
+  };
+
+  const auto bytes = std::as_bytes(std::span{data});
+  buffer.resize(buffer.size() + bytes.size());
+  std::memcpy(buffer.data() + buffer.size() - bytes.size(), bytes.data(), bytes.size());
+}
+
+int add_buffer_view(
+  tinygltf::Model& model, const baked::SectionRange& range, std::size_t stride, int target)
+{
+  tinygltf::BufferView view;
+  view.buffer = 0;
+  view.byteOffset = range.offset;
+  view.byteLength = range.size;
+  view.byteStride = stride;
+  view.target = target;
+  model.bufferViews.push_back(std::move(view));
+  return static_cast<int>(model.bufferViews.size() - 1);
+}
+
+int add_accessor(
+  tinygltf::Model& model,
+  int buffer_view,
+  std::size_t byte_offset,
+  int component_type,
+  int type,
+  std::size_t count,
+  bool normalized = false)
+{
+  tinygltf::Accessor accessor;
+  accessor.bufferView = buffer_view;
+  accessor.byteOffset = byte_offset;
+  accessor.componentType = component_type;
+  accessor.type = type;
+  accessor.count = count;
+  accessor.normalized = normalized;
+  model.accessors.push_back(std::move(accessor));
+  return static_cast<int>(model.accessors.size() - 1);
+}
+
+void add_extension(std::vector<std::string>& extensions, const std::string& extension)
+{
+  if (std::find(extensions.begin(), extensions.end(), extension) == extensions.end())
+    extensions.push_back(extension);
+}
+
+} // namespace
+
+bool bake_scene(const std::filesystem::path& src, const std::filesystem::path& dst)
+{
+  auto maybeModel = load_model(src);
+  if (!maybeModel.has_value())
+    return false;
+
+  auto model = std::move(*maybeModel);
+
+  auto maybeMeshes = bake_meshes(model);
+  if (!maybeMeshes.has_value())
+  {
+    spdlog::error("Failed to bake meshes of '{}'", src);
+    return false;
+  }
+
+  auto& meshes = *maybeMeshes;
+
+  drop_empty_meshes(model, meshes);
+  const auto instances = flatten_instances(model);
+
+  weld_meshes(meshes, src);
+  optimize_meshes(meshes, src);
+  build_relem_meshlets(meshes);
+  compute_relem_bounds(meshes);
+  build_lods(meshes);
+  meshes.shortIndices = narrow_indices(meshes.indices, meshes.relems);
+
+  // The binary part starts with the header, followed by GPU-ready vertices and indices and
+  // the scene tables. Everything the renderer needs can be found without parsing the json.
+  std::vector<unsigned char> bin(sizeof(baked::Header), 0);
+
+  baked::Header header{
+    .magic = baked::MAGIC,
+    .version = baked::VERSION,
+    .vertexStride = sizeof(baked::Vertex),
+    .sectionCount = baked::SECTION_COUNT,
+    .sections = {},
+  };
+
+  append_section(bin, header, baked::Section::Vertices, meshes.vertices);
+  append_section(bin, header, baked::Section::Indices, meshes.indices);
+  append_section(bin, header, baked::Section::RenderElements, meshes.relems);
+  append_section(bin, header, baked::Section::Meshes, meshes.meshes);
+  append_section(bin, header, baked::Section::InstanceMatrices, instances.matrices);
+  append_section(bin, header, baked::Section::InstanceMeshes, instances.meshes);
+  append_section(bin, header, baked::Section::Meshlets, meshes.meshlets);
+  append_section(bin, header, baked::Section::ShortIndices, meshes.shortIndices);
+
+  std::memcpy(bin.data(), &header, sizeof(header));
+
+  // Now rewrite the json part to describe the baked data. Everything that referenced the old
+  // buffers except for images is dropped, as the renderer doesn't support it anyway.
+  if (!model.animations.empty() || !model.skins.empty())
+    spdlog::warn("Animations and skins are not supported, dropping them from '{}'", src);
+
+  model.animations.clear();
+  model.skins.clear();
+  for (auto& node : model.nodes)
+    node.skin = -1;
+
+  auto oldBufferViews = std::move(model.bufferViews);
+  auto oldBuffers = std::move(model.buffers);
+  model.bufferViews.clear();
+  model.accessors.clear();
+
+  // Images embedded into the buffers are copied over as is
+  for (auto& image : model.images)
+  {
+    if (image.bufferView < 0)
+      continue;
+
+    const auto& oldView = oldBufferViews[image.bufferView];
+    const auto& oldData = oldBuffers[oldView.buffer].data;
+
+    align_buffer(bin);
+    const baked::SectionRange range{.offset = bin.size(), .size = oldView.byteLength};
+    bin.insert(
+      bin.end(),
+      oldData.begin() + static_cast<std::ptrdiff_t>(oldView.byteOffset),
+      oldData.begin() + static_cast<std::ptrdiff_t>(oldView.byteOffset + oldView.byteLength));
+
+    image.bufferView = add_buffer_view(model, range, 0, 0);
+  }
+
+  const auto vertexSection = header.sections[static_cast<std::size_t>(baked::Section::Vertices)];
+  const auto indexSection = header.sections[static_cast<std::size_t>(baked::Section::Indices)];
+  const auto shortIndexSection =
+    header.sections[static_cast<std::size_t>(baked::Section::ShortIndices)];
+
+  // NOTE: glTF forbids empty buffer views, and either of the index sections may be empty
+  const int vertexView =
+    add_buffer_view(model, vertexSection, sizeof(baked::Vertex), TINYGLTF_TARGET_ARRAY_BUFFER);
+  const int indexView = indexSection.size > 0
+    ? add_buffer_view(model, indexSection, 0, TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER)
+    : -1;
+  const int shortIndexView = shortIndexSection.size > 0
+    ? add_buffer_view(model, shortIndexSection, 0, TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER)
+    : -1;
+
+  for (std::size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx)
+  {
+    auto& mesh = model.meshes[meshIdx];
+    const auto& bakedMesh = meshes.meshes[meshIdx];
+
+    if (!mesh.weights.empty())
+      spdlog::warn("Morph targets are not supported, dropping them from '{}'", src);
+    mesh.weights.clear();
+
+    mesh.primitives.clear();
+    for (std::uint32_t i = 0; i < bakedMesh.relemCount; ++i)
+    {
+      const auto& relem = meshes.relems[bakedMesh.firstRelem + i];
+      const auto& info = meshes.primitives[bakedMesh.firstRelem + i];
+
+      const std::size_t vertexOffset = relem.vertexOffset * sizeof(baked::Vertex);
+
+      tinygltf::Primitive prim;
+      prim.mode = TINYGLTF_MODE_TRIANGLES;
+      prim.material = info.material;
+
+      const int positionAccessor = add_accessor(
+        model,
+        vertexView,
+        vertexOffset + offsetof(baked::Vertex, position),
+        TINYGLTF_COMPONENT_TYPE_FLOAT,
+        TINYGLTF_TYPE_VEC3,
+        info.vertexCount);
+      model.accessors[positionAccessor].minValues = {
+        info.positionMin.x, info.positionMin.y, info.positionMin.z};
+      model.accessors[positionAccessor].maxValues = {
+        info.positionMax.x, info.positionMax.y, info.positionMax.z};
+      prim.attributes["POSITION"] = positionAccessor;
+
+      if (info.hasNormals)
+        prim.attributes["NORMAL"] = add_accessor(
+          model,
+          vertexView,
+          vertexOffset + offsetof(baked::Vertex, normal),
+          TINYGLTF_COMPONENT_TYPE_BYTE,
+          TINYGLTF_TYPE_VEC3,
+          info.vertexCount,
+          true);
+
+      if (info.hasTexcoord)
+        prim.attributes["TEXCOORD_0"] = add_accessor(
+          model,
+          vertexView,
+          vertexOffset + offsetof(baked::Vertex, texCoord),
+          TINYGLTF_COMPONENT_TYPE_FLOAT,
+          TINYGLTF_TYPE_VEC2,
+          info.vertexCount);
+
+      if (info.hasTangents)
+        prim.attributes["TANGENT"] = add_accessor(
+          model,
+          vertexView,
+          vertexOffset + offsetof(baked::Vertex, tangent),
+          TINYGLTF_COMPONENT_TYPE_BYTE,
+          TINYGLTF_TYPE_VEC4,
+          info.vertexCount,
+          true);
+
+      prim.indices = relem.indexFormat == IndexFormat::U16
+        ? add_accessor(
+            model,
+            shortIndexView,
+            relem.indexOffset * sizeof(std::uint16_t),
+            TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
+            TINYGLTF_TYPE_SCALAR,
+            relem.indexCount)
+        : add_accessor(
+            model,
+            indexView,
+            relem.indexOffset * sizeof(std::uint32_t),
+            TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
+            TINYGLTF_TYPE_SCALAR,
+            relem.indexCount);
+
+      mesh.primitives.push_back(std::move(prim));
+    }
+  }
+
+  auto binPath = dst;
+  binPath.replace_extension(".bin");
+
+  tinygltf::Buffer buffer;
+  buffer.uri = binPath.filename().string();
+  buffer.data = std::move(bin);
+  model.buffers = {std::move(buffer)};
+
+  add_extension(model.extensionsUsed, QUANTIZATION_EXTENSION);
+  add_extension(model.extensionsRequired, QUANTIZATION_EXTENSION);
+
+  tinygltf::TinyGLTF writer;
+  if (!writer.WriteGltfSceneToFile(&model, dst.string(), false, false, true, false))
+  {
+    spdlog::error("glTF: Failed to write '{}'", dst);
+    return false;
+  }
+
+  spdlog::info(
+    "Baked '{}': {} vertices, {} 32-bit and {} 16-bit indices (including LODs), {} render "
+    "elements, {} meshlets, {} instances",
+    src,
+    meshes.vertices.size(),
+    meshes.indices.size(),
+    meshes.shortIndices.size(),
+    meshes.relems.size(),
+    meshes.meshlets.size(),
+    instances.matrices.size());
+
+  return true;
+}
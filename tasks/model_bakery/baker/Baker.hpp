@@ -0,0 +1,8 @@
+#pragma once
+
+#include <filesystem>
+
+
+// Converts the glTF scene at `src` into a render-ready one at `dst`, with the binary part
+// placed next to it. See ../README.md and common/scene/BakedScene.hpp for the format.
+bool bake_scene(const std::filesystem::path& src, const std::filesystem::path& dst);
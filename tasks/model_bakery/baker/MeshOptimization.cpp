@@ -0,0 +1,280 @@
+#include "MeshOptimization.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+
+namespace
+{
+
+constexpr std::uint32_t NO_VERTEX = std::numeric_limits<std::uint32_t>::max();
+
+// Vertex to triangle adjacency stored as a flat array of triangle lists
+struct Adjacency
+{
+  std::vector<std::uint32_t> offsets;
+  std::vector<std::uint32_t> triangles;
+
+  std::span<const std::uint32_t> get(std::uint32_t vertex) const
+  {
+    return std::span{triangles}.subspan(offsets[vertex], offsets[vertex + 1] - offsets[vertex]);
+  }
+};
+
+Adjacency build_adjacency(std::span<const std::uint32_t> indices, std::size_t vertex_count)
+{
+  Adjacency result;
+  result.offsets.assign(vertex_count + 1, 0);
+  result.triangles.resize(indices.size());
+
+  for (auto index : indices)
+    ++result.offsets[index + 1];
+  std::partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+
+  std::vector<std::uint32_t> cursors(result.offsets.begin(), result.offsets.end() - 1);
+  for (std::size_t i = 0; i < indices.size(); ++i)
+    result.triangles[cursors[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+
+  return result;
+}
+
+// Returns the list of triangle indices where a new cluster starts (always including 0)
+std::vector<std::size_t> tipsify(
+  std::span<const std::uint32_t> indices,
+  std::size_t vertex_count,
+  std::vector<std::uint32_t>& out_triangles)
+{
+  const auto adjacency = build_adjacency(indices, vertex_count);
+
+  std::vector<std::uint32_t> liveTriangles(vertex_count);
+  for (std::uint32_t v = 0; v < vertex_count; ++v)
+    liveTriangles[v] = static_cast<std::uint32_t>(adjacency.get(v).size());
+
+  std::vector<std::uint32_t> cacheTimestamps(vertex_count, 0);
+  std::vector<bool> emitted(indices.size() / 3, false);
+  std::vector<std::uint32_t> deadEnds;
+  std::vector<std::uint32_t> candidates;
+  std::vector<std::size_t> clusterStarts;
+
+  std::uint32_t timestamp = VERTEX_CACHE_SIZE + 1;
+  std::uint32_t cursor = 0;
+
+  auto skipDeadEnd = [&]() {
+    while (!deadEnds.empty())
+    {
+      const auto vertex = deadEnds.back();
+      deadEnds.pop_back();
+      if (liveTriangles[vertex] > 0)
+        return vertex;
+    }
+
+    // NOTE: jumping to an arbitrary vertex effectively flushes the cache,
+    // so this is where the overdraw pass is free to reorder clusters.
+    while (cursor < vertex_count)
+    {
+      if (liveTriangles[cursor] > 0)
+      {
+        clusterStarts.push_back(out_triangles.size());
+        return cursor;
+      }
+      ++cursor;
+    }
+
+    return NO_VERTEX;
+  };
+
+  auto nextVertex = [&]() {
+    std::uint32_t best = NO_VERTEX;
+    std::int64_t bestPriority = -1;
+    for (auto vertex : candidates)
+    {
+      if (liveTriangles[vertex] == 0)
+        continue;
+
+      // Prefer vertices that will still be in the cache after emitting all of their triangles
+      std::int64_t priority = 0;
+      const std::int64_t age = timestamp - cacheTimestamps[vertex];
+      if (age + 2 * std::int64_t{liveTriangles[vertex]} <= std::int64_t{VERTEX_CACHE_SIZE})
+        priority = age;
+
+      if (priority > bestPriority)
+      {
+        bestPriority = priority;
+        best = vertex;
+      }
+    }
+
+    return best != NO_VERTEX ? best : skipDeadEnd();
+  };
+
+  out_triangles.clear();
+  out_triangles.reserve(indices.size() / 3);
+
+  std::uint32_t fanning = skipDeadEnd();
+  while (fanning != NO_VERTEX)
+  {
+    candidates.clear();
+    for (auto triangle : adjacency.get(fanning))
+    {
+      if (emitted[triangle])
+        continue;
+      emitted[triangle] = true;
+      out_triangles.push_back(triangle);
+
+      for (std::size_t k = 0; k < 3; ++k)
+      {
+        const auto vertex = indices[triangle * 3 + k];
+        deadEnds.push_back(vertex);
+        candidates.push_back(vertex);
+        --liveTriangles[vertex];
+        if (timestamp - cacheTimestamps[vertex] > VERTEX_CACHE_SIZE)
+          cacheTimestamps[vertex] = timestamp++;
+      }
+    }
+
+    fanning = nextVertex();
+  }
+
+  return clusterStarts;
+}
+
+} // namespace
+
+VertexCacheStats analyze_vertex_cache(
+  std::span<const std::uint32_t> indices, std::size_t vertex_count)
+{
+  if (indices.empty() || vertex_count == 0)
+    return VertexCacheStats{.acmr = 0, .atvr = 0};
+
+  // Simulates a FIFO cache by remembering when each vertex entered it
+  std::vector<std::size_t> insertedAt(vertex_count, std::numeric_limits<std::size_t>::max());
+  std::size_t misses = 0;
+
+  for (auto index : indices)
+  {
+    const bool cached = insertedAt[index] != std::numeric_limits<std::size_t>::max() &&
+      misses - insertedAt[index] < VERTEX_CACHE_SIZE;
+    if (!cached)
+      insertedAt[index] = misses++;
+  }
+
+  std::size_t usedVertices = 0;
+  for (auto inserted : insertedAt)
+    if (inserted != std::numeric_limits<std::size_t>::max())
+      ++usedVertices;
+
+  return VertexCacheStats{
+    .acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3),
+    .atvr = static_cast<float>(misses) / static_cast<float>(usedVertices),
+  };
+}
+
+void optimize_vertex_cache(
+  std::span<std::uint32_t> all_indices, std::span<const baked::Vertex> vertices)
+{
+  // NOTE: a trailing incomplete triangle is never drawn anyway, so it is left alone
+  const std::size_t triangleCount = all_indices.size() / 3;
+  if (triangleCount == 0)
+    return;
+
+  const auto indices = all_indices.first(triangleCount * 3);
+
+  std::vector<std::uint32_t> order;
+  auto clusterStarts = tipsify(indices, vertices.size(), order);
+  clusterStarts.push_back(order.size());
+
+  // Overdraw: clusters that face away from the mesh center are likely to occlude the rest,
+  // so they go first. This is the view-independent heuristic from the same paper.
+  struct Cluster
+  {
+    std::size_t begin;
+    std::size_t end;
+    float sortKey;
+  };
+
+  glm::vec3 meshCenter{0};
+  float meshArea = 0;
+
+  std::vector<Cluster> clusters;
+  std::vector<glm::vec3> clusterCenters;
+  std::vector<glm::vec3> clusterNormals;
+  for (std::size_t i = 0; i + 1 < clusterStarts.size(); ++i)
+  {
+    glm::vec3 center{0};
+    glm::vec3 normal{0};
+    float area = 0;
+    for (std::size_t t = clusterStarts[i]; t < clusterStarts[i + 1]; ++t)
+    {
+      const auto& a = vertices[indices[order[t] * 3 + 0]].position;
+      const auto& b = vertices[indices[order[t] * 3 + 1]].position;
+      const auto& c = vertices[indices[order[t] * 3 + 2]].position;
+
+      const glm::vec3 areaNormal = glm::cross(b - a, c - a);
+      const float triangleArea = glm::length(areaNormal);
+      center += (a + b + c) * (triangleArea / 3.0f);
+      normal += areaNormal;
+      area += triangleArea;
+    }
+
+    meshCenter += center;
+    meshArea += area;
+
+    clusters.push_back(Cluster{
+      .begin = clusterStarts[i],
+      .end = clusterStarts[i + 1],
+      .sortKey = 0,
+    });
+    clusterCenters.push_back(area > 0 ? center / area : center);
+    clusterNormals.push_back(normal);
+  }
+
+  if (meshArea > 0)
+    meshCenter /= meshArea;
+
+  for (std::size_t i = 0; i < clusters.size(); ++i)
+  {
+    const float normalLength = glm::length(clusterNormals[i]);
+    clusters[i].sortKey = normalLength > 0
+      ? glm::dot(clusterCenters[i] - meshCenter, clusterNormals[i] / normalLength)
+      : 0.0f;
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+    return a.sortKey > b.sortKey;
+  });
+
+  std::vector<std::uint32_t> result;
+  result.reserve(indices.size());
+  for (const auto& cluster : clusters)
+    for (std::size_t t = cluster.begin; t < cluster.end; ++t)
+      for (std::size_t k = 0; k < 3; ++k)
+        result.push_back(indices[order[t] * 3 + k]);
+
+  std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void optimize_vertex_fetch(std::span<std::uint32_t> indices, std::span<baked::Vertex> vertices)
+{
+  std::vector<std::uint32_t> remap(vertices.size(), NO_VERTEX);
+  std::vector<baked::Vertex> reordered;
+  reordered.reserve(vertices.size());
+
+  for (auto& index : indices)
+  {
+    if (remap[index] == NO_VERTEX)
+    {
+      remap[index] = static_cast<std::uint32_t>(reordered.size());
+      reordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  // NOTE: unreferenced vertices are kept at the end so that relem offsets stay intact
+  for (std::size_t i = 0; i < vertices.size(); ++i)
+    if (remap[i] == NO_VERTEX)
+      reordered.push_back(vertices[i]);
+
+  std::copy(reordered.begin(), reordered.end(), vertices.begin());
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "scene/BakedScene.hpp"
+
+
+// Size of the FIFO post-transform cache that the optimizations target and the stats
+// are computed for. Real hardware differs, but any sane cache benefits from the same order.
+inline constexpr std::size_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats
+{
+  // Average cache miss ratio, i.e. vertex shader invocations per triangle. 0.5 is ideal.
+  float acmr;
+  // Average transform to vertex ratio, 1.0 is ideal.
+  float atvr;
+};
+
+VertexCacheStats analyze_vertex_cache(
+  std::span<const std::uint32_t> indices, std::size_t vertex_count);
+
+// Reorders triangles of a single relem for post-transform cache hits using Tipsify
+// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+// Clusters of triangles between cache flushes are then sorted front-to-back in the
+// view-independent sense of the paper, which reduces overdraw at no vertex cache cost.
+void optimize_vertex_cache(
+  std::span<std::uint32_t> all_indices, std::span<const baked::Vertex> vertices);
+
+// Reorders vertices of a single relem in the order of their first use, so that
+// vertex fetches follow the index buffer linearly. Indices are remapped accordingly.
+void optimize_vertex_fetch(std::span<std::uint32_t> indices, std::span<baked::Vertex> vertices);
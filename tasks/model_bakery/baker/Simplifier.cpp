@@ -0,0 +1,363 @@
+#include "Simplifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+
+namespace
+{
+
+// Symmetric 4x4 matrix measuring the sum of squared distances to a set of planes
+struct Quadric
+{
+  std::array<double, 10> m{};
+
+  void addPlane(glm::dvec4 p)
+  {
+    m[0] += p.x * p.x;
+    m[1] += p.x * p.y;
+    m[2] += p.x * p.z;
+    m[3] += p.x * p.w;
+    m[4] += p.y * p.y;
+    m[5] += p.y * p.z;
+    m[6] += p.y * p.w;
+    m[7] += p.z * p.z;
+    m[8] += p.z * p.w;
+    m[9] += p.w * p.w;
+  }
+
+  void add(const Quadric& other)
+  {
+    for (std::size_t i = 0; i < m.size(); ++i)
+      m[i] += other.m[i];
+  }
+
+  double evaluate(glm::dvec3 v) const
+  {
+    const double result = m[0] * v.x * v.x + 2 * m[1] * v.x * v.y + 2 * m[2] * v.x * v.z +
+      2 * m[3] * v.x + m[4] * v.y * v.y + 2 * m[5] * v.y * v.z + 2 * m[6] * v.y +
+      m[7] * v.z * v.z + 2 * m[8] * v.z + m[9];
+    // NOTE: can be slightly negative due to rounding
+    return std::max(result, 0.0);
+  }
+};
+
+struct Collapse
+{
+  double cost;
+  std::uint32_t from;
+  std::uint32_t to;
+  std::uint32_t fromVersion;
+  std::uint32_t toVersion;
+
+  bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+struct PositionHash
+{
+  std::size_t operator()(const glm::vec3& p) const
+  {
+    const auto x = std::bit_cast<std::uint32_t>(p.x);
+    const auto y = std::bit_cast<std::uint32_t>(p.y);
+    const auto z = std::bit_cast<std::uint32_t>(p.z);
+    return (x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u);
+  }
+};
+
+struct PositionEqual
+{
+  bool operator()(const glm::vec3& a, const glm::vec3& b) const
+  {
+    return std::bit_cast<std::uint32_t>(a.x) == std::bit_cast<std::uint32_t>(b.x) &&
+      std::bit_cast<std::uint32_t>(a.y) == std::bit_cast<std::uint32_t>(b.y) &&
+      std::bit_cast<std::uint32_t>(a.z) == std::bit_cast<std::uint32_t>(b.z);
+  }
+};
+
+// How well the attributes of two vertices match, the higher the better
+float wedge_similarity(const baked::Vertex& a, const baked::Vertex& b)
+{
+  float normalDot = 0;
+  for (std::size_t i = 0; i < 3; ++i)
+    normalDot += static_cast<float>(a.normal[i]) * static_cast<float>(b.normal[i]);
+  return normalDot / (127.0f * 127.0f) - glm::length(a.texCoord - b.texCoord);
+}
+
+class Simplifier
+{
+public:
+  Simplifier(std::span<const std::uint32_t> indices, std::span<const baked::Vertex> vertices)
+    : vertices{vertices}
+    , wedges(indices.begin(), indices.end())
+  {
+    buildGroups();
+
+    const std::size_t triangleCount = wedges.size() / 3;
+    corners.resize(triangleCount * 3);
+    triangleAlive.assign(triangleCount, true);
+    groupTriangles.resize(groupPositions.size());
+    groupQuadrics.resize(groupPositions.size());
+    groupLocked.assign(groupPositions.size(), false);
+    groupVersions.assign(groupPositions.size(), 0);
+    aliveTriangles = triangleCount;
+
+    for (std::size_t t = 0; t < triangleCount; ++t)
+    {
+      for (std::size_t k = 0; k < 3; ++k)
+      {
+        corners[t * 3 + k] = vertexGroups[wedges[t * 3 + k]];
+        groupTriangles[corners[t * 3 + k]].push_back(static_cast<std::uint32_t>(t));
+      }
+
+      const glm::dvec3 a{groupPositions[corners[t * 3 + 0]]};
+      const glm::dvec3 b{groupPositions[corners[t * 3 + 1]]};
+      const glm::dvec3 c{groupPositions[corners[t * 3 + 2]]};
+      const glm::dvec3 normal = glm::cross(b - a, c - a);
+      const double length = glm::length(normal);
+      if (length <= 0.0)
+        continue;
+
+      const glm::dvec3 n = normal / length;
+      for (std::size_t k = 0; k < 3; ++k)
+        groupQuadrics[corners[t * 3 + k]].addPlane(glm::dvec4(n, -glm::dot(n, a)));
+    }
+
+    lockBorders();
+  }
+
+  SimplifiedIndices run(std::size_t target_triangle_count)
+  {
+    for (std::uint32_t group = 0; group < groupPositions.size(); ++group)
+      pushCollapses(group);
+
+    double maxCost = 0;
+    while (aliveTriangles > target_triangle_count && !queue.empty())
+    {
+      const auto collapse = queue.top();
+      queue.pop();
+
+      if (
+        groupVersions[collapse.from] != collapse.fromVersion ||
+        groupVersions[collapse.to] != collapse.toVersion || !isValid(collapse.from, collapse.to))
+        continue;
+
+      maxCost = std::max(maxCost, collapse.cost);
+      perform(collapse.from, collapse.to);
+    }
+
+    SimplifiedIndices result{.indices = {}, .error = static_cast<float>(std::sqrt(maxCost))};
+    result.indices.reserve(aliveTriangles * 3);
+    for (std::size_t t = 0; t < triangleAlive.size(); ++t)
+      if (triangleAlive[t])
+        for (std::size_t k = 0; k < 3; ++k)
+          result.indices.push_back(wedges[t * 3 + k]);
+
+    return result;
+  }
+
+private:
+  void buildGroups()
+  {
+    std::unordered_map<glm::vec3, std::uint32_t, PositionHash, PositionEqual> groupsByPosition;
+    vertexGroups.resize(vertices.size());
+    for (std::uint32_t v = 0; v < vertices.size(); ++v)
+    {
+      const auto [it, inserted] = groupsByPosition.emplace(
+        vertices[v].position, static_cast<std::uint32_t>(groupPositions.size()));
+      if (inserted)
+      {
+        groupPositions.push_back(vertices[v].position);
+        groupWedges.emplace_back();
+      }
+      vertexGroups[v] = it->second;
+      groupWedges[it->second].push_back(v);
+    }
+  }
+
+  // Edges used by a single triangle are open borders, edges used by more
+  // than two are non-manifold. Moving either of those would open cracks.
+  void lockBorders()
+  {
+    std::unordered_map<std::uint64_t, std::uint32_t> edgeUses;
+    auto edgeKey = [](std::uint32_t a, std::uint32_t b) {
+      return (std::uint64_t{std::min(a, b)} << 32) | std::max(a, b);
+    };
+
+    for (std::size_t t = 0; t < triangleAlive.size(); ++t)
+      for (std::size_t k = 0; k < 3; ++k)
+        ++edgeUses[edgeKey(corners[t * 3 + k], corners[t * 3 + (k + 1) % 3])];
+
+    for (const auto& [key, uses] : edgeUses)
+      if (uses != 2)
+      {
+        groupLocked[static_cast<std::uint32_t>(key >> 32)] = true;
+        groupLocked[static_cast<std::uint32_t>(key & 0xFFFFFFFF)] = true;
+      }
+  }
+
+  void pushCollapses(std::uint32_t group)
+  {
+    for (auto t : groupTriangles[group])
+    {
+      if (!triangleAlive[t])
+        continue;
+
+      for (std::size_t k = 0; k < 3; ++k)
+      {
+        const auto other = corners[t * 3 + k];
+        if (other == group)
+          continue;
+
+        // Both directions, as only one of them might be allowed
+        for (auto [from, to] : {std::pair{group, other}, std::pair{other, group}})
+        {
+          if (groupLocked[from])
+            continue;
+
+          Quadric quadric = groupQuadrics[from];
+          quadric.add(groupQuadrics[to]);
+          queue.push(Collapse{
+            .cost = quadric.evaluate(glm::dvec3{groupPositions[to]}),
+            .from = from,
+            .to = to,
+            .fromVersion = groupVersions[from],
+            .toVersion = groupVersions[to],
+          });
+        }
+      }
+    }
+  }
+
+  bool isValid(std::uint32_t from, std::uint32_t to) const
+  {
+    bool adjacent = false;
+    for (auto t : groupTriangles[from])
+    {
+      if (!triangleAlive[t])
+        continue;
+
+      const auto* tri = &corners[t * 3];
+      if (tri[0] == to || tri[1] == to || tri[2] == to)
+      {
+        adjacent = true;
+        continue;
+      }
+
+      // Triangles that survive the collapse must not flip
+      std::array<glm::vec3, 3> before;
+      std::array<glm::vec3, 3> after;
+      for (std::size_t k = 0; k < 3; ++k)
+      {
+        before[k] = groupPositions[tri[k]];
+        after[k] = tri[k] == from ? groupPositions[to] : before[k];
+      }
+
+      const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+      const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+      if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+        return false;
+    }
+
+    return adjacent;
+  }
+
+  void perform(std::uint32_t from, std::uint32_t to)
+  {
+    groupQuadrics[to].add(groupQuadrics[from]);
+
+    for (auto t : groupTriangles[from])
+    {
+      if (!triangleAlive[t])
+        continue;
+
+      auto* tri = &corners[t * 3];
+      if (tri[0] == to || tri[1] == to || tri[2] == to)
+      {
+        triangleAlive[t] = false;
+        --aliveTriangles;
+        continue;
+      }
+
+      for (std::size_t k = 0; k < 3; ++k)
+        if (tri[k] == from)
+        {
+          tri[k] = to;
+          wedges[t * 3 + k] = closestWedge(wedges[t * 3 + k], to);
+        }
+
+      groupTriangles[to].push_back(t);
+    }
+
+    groupTriangles[from].clear();
+    groupLocked[from] = true;
+
+    // Costs of all collapses around the merged group are now outdated
+    ring.clear();
+    for (auto t : groupTriangles[to])
+      if (triangleAlive[t])
+        for (std::size_t k = 0; k < 3; ++k)
+          ring.push_back(corners[t * 3 + k]);
+    std::sort(ring.begin(), ring.end());
+    ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+
+    ++groupVersions[from];
+    for (auto group : ring)
+      ++groupVersions[group];
+    for (auto group : ring)
+      pushCollapses(group);
+  }
+
+  std::uint32_t closestWedge(std::uint32_t wedge, std::uint32_t group) const
+  {
+    std::uint32_t best = groupWedges[group].front();
+    float bestSimilarity = std::numeric_limits<float>::lowest();
+    for (auto candidate : groupWedges[group])
+    {
+      const float similarity = wedge_similarity(vertices[wedge], vertices[candidate]);
+      if (similarity > bestSimilarity)
+      {
+        bestSimilarity = similarity;
+        best = candidate;
+      }
+    }
+    return best;
+  }
+
+private:
+  std::span<const baked::Vertex> vertices;
+
+  // Vertex indices of every triangle corner, what ends up in the index buffer
+  std::vector<std::uint32_t> wedges;
+  // Position group of every triangle corner
+  std::vector<std::uint32_t> corners;
+  std::vector<bool> triangleAlive;
+  std::size_t aliveTriangles = 0;
+
+  std::vector<std::uint32_t> vertexGroups;
+  std::vector<glm::vec3> groupPositions;
+  std::vector<std::vector<std::uint32_t>> groupWedges;
+  std::vector<std::vector<std::uint32_t>> groupTriangles;
+  std::vector<Quadric> groupQuadrics;
+  std::vector<bool> groupLocked;
+  std::vector<std::uint32_t> groupVersions;
+
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> queue;
+  std::vector<std::uint32_t> ring;
+};
+
+} // namespace
+
+SimplifiedIndices simplify(
+  std::span<const std::uint32_t> indices,
+  std::span<const baked::Vertex> vertices,
+  std::size_t target_triangle_count)
+{
+  Simplifier simplifier{indices.first(indices.size() - indices.size() % 3), vertices};
+  return simplifier.run(target_triangle_count);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "scene/BakedScene.hpp"
+
+
+struct SimplifiedIndices
+{
+  std::vector<std::uint32_t> indices;
+  // Approximate maximal deviation from the original surface, in mesh space units
+  float error;
+};
+
+// Quadric error metric edge collapse (Garland & Heckbert) down to at most
+// target_triangle_count triangles, if that is possible without flipping triangles.
+// Vertices are never moved or created, so the result indexes the same vertex buffer.
+// Collapses happen between groups of vertices that share a position, so that
+// normal and UV seams don't tear. Open borders are locked, which keeps the borders
+// between relems of a mesh intact no matter which LODs they end up using.
+SimplifiedIndices simplify(
+  std::span<const std::uint32_t> indices,
+  std::span<const baked::Vertex> vertices,
+  std::size_t target_triangle_count);
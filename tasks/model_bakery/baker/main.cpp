@@ -1,4 +1,116 @@
-int main()
+#include <atomic>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#include "parallel/ThreadPool.hpp"
+#include "Baker.hpp"
+
+
+namespace
 {
+
+constexpr std::string_view BAKED_SUFFIX = "_baked";
+
+bool is_gltf(const std::filesystem::path& path)
+{
+  return path.extension() == ".gltf" || path.extension() == ".glb";
+}
+
+bool is_baked(const std::filesystem::path& path)
+{
+  return path.stem().string().ends_with(BAKED_SUFFIX);
+}
+
+std::filesystem::path get_baked_path(const std::filesystem::path& src)
+{
+  auto result = src;
+  result.replace_filename(src.stem().string() + std::string(BAKED_SUFFIX) + ".gltf");
+  return result;
+}
+
+// Output is considered up to date when both of its files are newer than the source
+bool is_up_to_date(const std::filesystem::path& src, const std::filesystem::path& dst)
+{
+  auto binPath = dst;
+  binPath.replace_extension(".bin");
+
+  std::error_code error;
+  const auto srcTime = std::filesystem::last_write_time(src, error);
+  if (error)
+    return false;
+
+  for (const auto& output : {dst, binPath})
+  {
+    const auto outputTime = std::filesystem::last_write_time(output, error);
+    if (error || outputTime < srcTime)
+      return false;
+  }
+
+  return true;
+}
+
+// Directories are searched recursively for not yet baked glTF files
+void collect_inputs(const std::filesystem::path& path, std::vector<std::filesystem::path>& inputs)
+{
+  if (!std::filesystem::is_directory(path))
+  {
+    inputs.push_back(path);
+    return;
+  }
+
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(path))
+    if (entry.is_regular_file() && is_gltf(entry.path()) && !is_baked(entry.path()))
+      inputs.push_back(entry.path());
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  std::vector<std::filesystem::path> inputs;
+  bool force = false;
+
+  for (std::string_view arg : std::span{argv, static_cast<std::size_t>(argc)}.subspan(1))
+    if (arg == "--force")
+      force = true;
+    else
+      collect_inputs(arg, inputs);
+
+  if (inputs.empty())
+  {
+    spdlog::error("Usage: model_bakery_baker [--force] <scene.gltf | directory>...");
+    return 1;
+  }
+
+  std::atomic<std::size_t> failures = 0;
+
+  // NOTE: every scene is baked by a single thread, which is plenty
+  // as long as there are more scenes than cores.
+  ThreadPool pool;
+  pool.parallelFor(inputs.size(), [&](std::size_t i) {
+    const auto& src = inputs[i];
+    const auto dst = get_baked_path(src);
+
+    if (!force && is_up_to_date(src, dst))
+    {
+      spdlog::info("'{}' is up to date, skipping it", dst);
+      return;
+    }
+
+    if (!bake_scene(src, dst))
+      ++failures;
+  });
+
+  if (failures > 0)
+  {
+    spdlog::error("Failed to bake {} out of {} scenes", failures.load(), inputs.size());
+    return 1;
+  }
+
   return 0;
 }
@@ -1,5 +1,7 @@
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/RenderTargetStates.hpp>
@@ -7,6 +9,16 @@
 #include <glm/ext.hpp>
 
 
+namespace
+{
+
+// NOTE: a mesh is allowed to switch to a coarser LOD while the simplification
+// error projected on the screen stays below this amount of pixels
+constexpr float LOD_PIXEL_THRESHOLD = 1.0f;
+constexpr float MIN_LOD_DISTANCE = 1e-3f;
+
+} // namespace
+
 WorldRenderer::WorldRenderer()
   : sceneMgr{std::make_unique<SceneManager>()}
 {
@@ -28,7 +40,10 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
-  sceneMgr->selectScene(path);
+  // NOTE: this renderer expects scenes produced by model_bakery_baker
+  ETNA_VERIFY(path.stem().string().ends_with("_baked"));
+  sceneMgr->selectBakedScene(path);
+  ETNA_VERIFY(sceneMgr->getVertexBuffer());
 }
 
 void WorldRenderer::loadShaders()
@@ -44,7 +59,7 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
   etna::VertexShaderInputDescription sceneVertexInputDesc{
     .bindings = {etna::VertexShaderInputDescription::Binding{
-      .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
+      .byteStreamDescription = sceneMgr->getBakedVertexFormatDescription(),
     }},
   };
 
@@ -81,18 +96,62 @@ void WorldRenderer::update(const FramePacket& packet)
     const float aspect = float(resolution.x) / float(resolution.y);
     worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
   }
+
+  // LOD selection parameters
+  {
+    eyePosition = packet.mainCam.position;
+    lodErrorScale =
+      float(resolution.y) / (2.0f * glm::tan(glm::radians(packet.mainCam.fov) * 0.5f));
+  }
+}
+
+std::size_t WorldRenderer::selectLod(std::uint32_t mesh_idx, const glm::mat4x4& model) const
+{
+  const auto& mesh = sceneMgr->getMeshes()[mesh_idx];
+
+  const float scale = std::max(
+    {glm::length(glm::vec3(model[0])),
+     glm::length(glm::vec3(model[1])),
+     glm::length(glm::vec3(model[2]))});
+  const auto center = glm::vec3(model * glm::vec4(mesh.bounds.sphereCenter, 1.0f));
+
+  // Distance to the closest point of the bounding sphere, the camera may be inside
+  const float distance = std::max(
+    glm::length(center - eyePosition) - mesh.bounds.sphereRadius * scale, MIN_LOD_DISTANCE);
+
+  // LOD errors only grow, so the first level that is too coarse ends the search
+
+  std::size_t lod = 0;
+  for (std::size_t i = 1; i < mesh.lodCount; ++i)
+  {
+    if (mesh.lodErrors[i] * scale / distance * lodErrorScale > LOD_PIXEL_THRESHOLD)
+      break;
+    lod = i;
+  }
+  return lod;
 }
 
 void WorldRenderer::renderScene(
   vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
 {
-  if (!sceneMgr->getVertexBuffer())
+  if (!sceneMgr->getVertexBuffer() || !sceneMgr->getInstanceBuffer().get())
     return;
 
+  auto set = etna::create_descriptor_set(
+    etna::get_shader_program("static_mesh_material").getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, sceneMgr->getInstanceBuffer().genBinding()}});
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, {set.getVkSet()}, {});
+
   cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
 
-  pushConst2M.projView = glob_tm;
+  SceneManager::IndexBinder indexBinder{*sceneMgr, cmd_buf};
+
+  // NOTE: model matrices come from the instance buffer, so there is one push per pass
+  pushConst.projView = glob_tm;
+  cmd_buf.pushConstants<PushConstants>(
+    pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst});
 
   auto instanceMeshes = sceneMgr->getInstanceMeshes();
   auto instanceMatrices = sceneMgr->getInstanceMatrices();
@@ -100,21 +159,33 @@ void WorldRenderer::renderScene(
   auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  for (std::size_t firstInst = 0; firstInst < instanceMeshes.size();)
   {
-    pushConst2M.model = instanceMatrices[instIdx];
+    const auto meshIdx = instanceMeshes[firstInst];
+    const auto lod = selectLod(meshIdx, instanceMatrices[firstInst]);
 
-    cmd_buf.pushConstants<PushConstants>(
-      pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
-
-    const auto meshIdx = instanceMeshes[instIdx];
+    // NOTE: instances are sorted by mesh, so neighbours that also
+    // end up with the same LOD are drawn together with instanced calls.
+    std::size_t endInst = firstInst + 1;
+    while (
+      endInst < instanceMeshes.size() && instanceMeshes[endInst] == meshIdx &&
+      selectLod(meshIdx, instanceMatrices[endInst]) == lod)
+      ++endInst;
 
     for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
     {
       const auto relemIdx = meshes[meshIdx].firstRelem + j;
-      const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      indexBinder.bind(relems[relemIdx].indexFormat);
+      const auto indices = get_lod_indices(relems[relemIdx], lod);
+      cmd_buf.drawIndexed(
+        indices.count,
+        static_cast<std::uint32_t>(endInst - firstInst),
+        indices.offset,
+        relems[relemIdx].vertexOffset,
+        static_cast<std::uint32_t>(firstInst));
     }
+
+    firstInst = endInst;
   }
 }
 
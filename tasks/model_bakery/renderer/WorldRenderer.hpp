@@ -30,6 +30,7 @@ public:
     vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
 
 private:
+  std::size_t selectLod(std::uint32_t mesh_idx, const glm::mat4x4& model) const;
   void renderScene(
     vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
 
@@ -43,12 +44,15 @@ private:
   struct PushConstants
   {
     glm::mat4x4 projView;
-    glm::mat4x4 model;
-  } pushConst2M;
+  } pushConst;
 
   glm::mat4x4 worldViewProj;
   glm::mat4x4 lightMatrix;
 
+  glm::vec3 eyePosition{};
+  // Converts an error-to-distance ratio into pixels on screen
+  float lodErrorScale = 0;
+
   etna::GraphicsPipeline staticMeshPipeline{};
 
   glm::uvec2 resolution;
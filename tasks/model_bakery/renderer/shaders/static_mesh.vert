@@ -2,18 +2,25 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : require
 
-#include "unpack_attributes.glsl"
+#include "InstanceData.h"
 
 
-layout(location = 0) in vec4 vPosNorm;
-layout(location = 1) in vec4 vTexCoordAndTang;
+// See common/scene/BakedScene.hpp, normals and tangents are snorm8
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec4 vNorm;
+layout(location = 2) in vec2 vTexCoord;
+layout(location = 3) in vec4 vTang;
 
 layout(push_constant) uniform params_t
 {
   mat4 mProjView;
-  mat4 mModel;
 } params;
 
+layout(binding = 0, set = 0) readonly buffer Instances
+{
+  InstanceData instances[];
+};
+
 
 layout (location = 0 ) out VS_OUT
 {
@@ -27,13 +34,12 @@ out gl_PerVertex { vec4 gl_Position; };
 
 void main(void)
 {
-  const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
-  const vec4 wTang = vec4(decode_normal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
+  const InstanceData instance = instances[gl_InstanceIndex];
 
-  vOut.wPos   = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
-  vOut.wNorm  = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
-  vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
-  vOut.texCoord = vTexCoordAndTang.xy;
+  vOut.wPos   = (instance.model * vec4(vPos, 1.0f)).xyz;
+  vOut.wNorm  = normalize(mat3(instance.normal) * vNorm.xyz);
+  vOut.wTangent = normalize(mat3(instance.normal) * vTang.xyz);
+  vOut.texCoord = vTexCoord;
 
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
 }